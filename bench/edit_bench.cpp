@@ -0,0 +1,54 @@
+/*
+ * edit-bench
+ * The edit-run cycle on programs of growing size: milliseconds of the
+ * first RUN, which parses every line, against a RUN after a one-line
+ * edit, which only parses the edited line.
+ * Usage: edit-bench [edits]
+*/
+#include "program.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QString>
+#include <QTextStream>
+#include <cstdio>
+#include <cstdlib>
+
+/* line
+* Text of line i of the program: straight-line arithmetic, so that the
+* run itself is short next to the parse.
+*/
+static QString line(int i, int variant)
+{
+    return QString("LET v%1 = (v%2 * %3 + %4) MOD 1000 + v%5 - (v%1 + 1) / 7")
+        .arg(i % 32).arg((i + 5) % 32).arg(i % 97 + variant).arg(i).arg((i + 11) % 32);
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    int edits = argc > 1 ? atoi(argv[1]) : 20;
+    printf("%-8s %12s %16s\n", "lines", "first RUN ms", "edit + RUN ms");
+    for(int lines : {1000, 10000, 100000}){
+        QString output;
+        QTextStream out(&output);
+        Program program(nullptr, true);
+        program.setStreams(nullptr, &out);
+        for(int i = 0; i < 32; i++) program.updateStatement(i + 1, QString("LET v%1 = %1").arg(i));
+        for(int i = 1; i <= lines; i++) program.updateStatement(100 + i * 10, line(i, 0));
+        QElapsedTimer timer;
+        timer.start();
+        program.execute();
+        double first = timer.nsecsElapsed() / 1e6;
+        qint64 best = -1;
+        for(int e = 1; e <= edits; e++){
+            int edited = lines / 2 + e;
+            timer.start();
+            program.updateStatement(100 + edited * 10, line(edited, e));
+            program.execute();
+            qint64 ns = timer.nsecsElapsed();
+            if(best < 0 || ns < best) best = ns;
+        }
+        printf("%-8d %12.2f %16.2f\n", lines, first, best / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * expression-bench
+ * Nanoseconds per evaluation of expressions of different shapes, run by
+ * the interpreter as LET s = <expression> in a FOR loop. The cost of the
+ * loop itself (LET s = i) is subtracted.
+ * Usage: expression-bench [iterations]
+*/
+#include "program.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <cstdio>
+#include <cstdlib>
+
+static const int repeats = 5;
+
+/* chain
+* terms copies of term joined by op.
+*/
+static QString chain(const QString& term, const QString& op, int terms)
+{
+    QStringList parts;
+    for(int i = 0; i < terms; i++) parts << term;
+    return parts.join(" " + op + " ");
+}
+
+/* measure
+* Best nanoseconds per iteration of LET s = expression over repeats runs.
+*/
+static double measure(const QString& expression, int iterations)
+{
+    qint64 best = -1;
+    for(int i = 0; i < repeats; i++){
+        QString output;
+        QTextStream out(&output);
+        Program program(nullptr, true);
+        program.setStreams(nullptr, &out);
+        program.updateStatement(10, "LET c = 3");
+        program.updateStatement(20, "DIM a(16)");
+        program.updateStatement(30, "FOR i = 1 TO " + QString::number(iterations));
+        program.updateStatement(40, "LET s = " + expression);
+        program.updateStatement(50, "NEXT i");
+        QElapsedTimer timer;
+        timer.start();
+        program.execute();
+        qint64 ns = timer.nsecsElapsed();
+        if(best < 0 || ns < best) best = ns;
+    }
+    return double(best) / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    struct Test
+    {
+        const char* name;
+        QString expression;
+    };
+    QString nested = "i";
+    for(int i = 0; i < 16; i++) nested = "(" + nested + " + " + QString::number(i) + ") * c";
+    const Test tests[] = {
+        {"sum of 16", chain("i", "+", 16)},
+        {"products", chain("(i + 1) * (i + 2)", "-", 4)},
+        {"nested 16", nested},
+        {"elements", chain("a(i MOD 16)", "+", 8)},
+        {"memoized", "i + " + chain("(c * 7 - 1) MOD 5", "+", 8)},
+        {"repeated", chain("(i * c + 1) MOD 7", "+", 8)},
+    };
+    double loop = measure("i", iterations);
+    printf("%d iterations, loop %.1f ns\n\n", iterations, loop);
+    for(const Test& test : tests)
+        printf("%-10s %8.1f ns/evaluation\n", test.name, measure(test.expression, iterations) - loop);
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * gosub-bench
+ * Nanoseconds per subroutine call run by the interpreter: a loop calling
+ * a short subroutine against the same loop with the subroutine written
+ * inline ("frequent"), and chains of nested calls ("deep").
+ * Usage: gosub-bench [calls] [depth]
+*/
+#include "program.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <cstdio>
+#include <cstdlib>
+
+static const int repeats = 5;
+
+/* loadProgram
+* Replace the program by lines ("<line> <statement>"), with %N replaced
+* by n and %D by depth.
+*/
+static void loadProgram(Program& program, const QStringList& lines, int n, int depth)
+{
+    program.clear();
+    for(QString line : lines){
+        line.replace("%N", QString::number(n));
+        line.replace("%D", QString::number(depth));
+        int space = line.indexOf(' ');
+        program.updateStatement(line.left(space).toInt(), line.mid(space + 1));
+    }
+}
+
+/* measure
+* Best nanoseconds per call of the program over repeats runs, which makes
+* calls calls. output receives what the last run printed.
+*/
+static double measure(const QStringList& lines, int n, int depth, long long calls, QString& output)
+{
+    qint64 best = -1;
+    for(int i = 0; i < repeats; i++){
+        output.clear();
+        QTextStream out(&output);
+        Program program(nullptr, true);
+        ExecutionLimits limits;
+        limits.maxCallDepth = depth + 1;
+        program.setLimits(limits);
+        program.setStreams(nullptr, &out);
+        loadProgram(program, lines, n, depth);
+        QElapsedTimer timer;
+        timer.start();
+        program.execute();
+        qint64 ns = timer.nsecsElapsed();
+        out.flush();
+        if(best < 0 || ns < best) best = ns;
+    }
+    return double(best) / calls;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    int calls = argc > 1 ? atoi(argv[1]) : 1000000;
+    int depth = argc > 2 ? atoi(argv[2]) : 1000;
+    printf("%d calls, nested %d deep\n\n", calls, depth);
+
+    const QStringList inlined = {
+        "10 LET s = 0", "20 FOR i = 1 TO %N", "30 LET s = s + i MOD 7", "40 NEXT i", "50 PRINT s"};
+    const QStringList frequent = {
+        "10 LET s = 0", "20 FOR i = 1 TO %N", "30 GOSUB 100", "40 NEXT i", "50 PRINT s", "60 END",
+        "100 LET s = s + i MOD 7", "110 RETURN"};
+    //every call of 100 but the last calls it again: depth calls per chain
+    const QStringList deep = {
+        "10 FOR r = 1 TO %N", "20 LET d = 0", "30 GOSUB 100", "40 NEXT r", "50 PRINT d", "60 END",
+        "100 LET d = d + 1", "110 IF d < %D THEN 130", "120 RETURN", "130 GOSUB 100", "140 RETURN"};
+
+    QString inlineOutput, frequentOutput, deepOutput;
+    double ns = measure(inlined, calls, 1, calls, inlineOutput);
+    printf("%-10s %-8s %8.1f ns/call\n", "frequent", "inline", ns);
+    ns = measure(frequent, calls, 1, calls, frequentOutput);
+    printf("%-10s %-8s %8.1f ns/call   (output %s)\n", "frequent", "gosub", ns,
+           inlineOutput == frequentOutput ? "matches" : "DIFFERS");
+    int chains = qMax(1, calls / depth);
+    ns = measure(deep, chains, depth, (long long)chains * depth, deepOutput);
+    printf("%-10s %-8s %8.1f ns/call   (output %s)\n", "deep", "gosub", ns, qPrintable(deepOutput.trimmed()));
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * lexicon-bench
+ * Nanoseconds per operation of identifier classification and command
+ * dispatch: the std::set/QString::compare code used before the lexicon
+ * ("legacy") against the keyword hash and the character table.
+ * Usage: lexicon-bench [iterations]
+*/
+#include "lexicon.h"
+#include <QElapsedTimer>
+#include <QString>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <set>
+#include <vector>
+
+static const int repeats = 5;
+
+/* measure
+* Best nanoseconds per operation of work over repeats runs.
+*/
+static double measure(long long operations, const std::function<long long()>& work, long long& check)
+{
+    qint64 best = -1;
+    for(int i = 0; i < repeats; i++){
+        QElapsedTimer timer;
+        timer.start();
+        check = work();
+        qint64 ns = timer.nsecsElapsed();
+        if(best < 0 || ns < best) best = ns;
+    }
+    return double(best) / operations;
+}
+
+/*
+ * The code used before the lexicon.
+*/
+static const std::set<QString> keywords = {
+    "LOAD", "RUN", "CLEAR", "QUIT", "LIST", "ADD", "DELETE", "PRINT", "LET", "INPUT",
+    "GOTO", "IF", "THEN", "END", "REM", "MOD"
+};
+
+static bool legacyIsValidVariableName(const QString& name)
+{
+    if (name.isEmpty()) return false;
+    if (keywords.find(name) != keywords.end()) return false;
+    QChar first = name[0];
+    if (!first.isLetter() && first != '_') return false;
+    for (int i = 1; i < name.length(); i++) {
+        QChar c = name[i];
+        if (!c.isLetterOrNumber() && c != '_') return false;
+    }
+    return true;
+}
+
+static int legacyDispatch(const QString& argv0)
+{
+    if (QString::compare(argv0, "LOAD") == 0) return 1;
+    else if (QString::compare(argv0, "RUN") == 0) return 2;
+    else if (QString::compare(argv0, "CLEAR") == 0) return 3;
+    else if (QString::compare(argv0, "QUIT") == 0) return 4;
+    else if (QString::compare(argv0, "LIST") == 0) return 5;
+    else if (argv0.toInt()) return 6;
+    else if (QString::compare(argv0, "ADD") == 0) return 7;
+    else if (QString::compare(argv0, "DELETE") == 0) return 8;
+    else if (QString::compare(argv0, "PRINT") == 0) return 9;
+    else if (QString::compare(argv0, "LET") == 0) return 10;
+    else if (QString::compare(argv0, "INPUT") == 0) return 11;
+    else if (QString::compare(argv0, "GOTO") == 0) return 12;
+    else if (QString::compare(argv0, "IF") == 0) return 13;
+    else if (QString::compare(argv0, "END") == 0) return 14;
+    else if (QString::compare(argv0, "REM") == 0) return 15;
+    return 0;
+}
+
+static int lexiconDispatch(const QString& argv0)
+{
+    switch (keywordOf(argv0)) {
+    case loadKw: return 1;
+    case runKw: return 2;
+    case clearKw: return 3;
+    case quitKw: return 4;
+    case listKw: return 5;
+    case addKw: return 7;
+    case deleteKw: return 8;
+    case printKw: return 9;
+    case letKw: return 10;
+    case inputKw: return 11;
+    case gotoKw: return 12;
+    case ifKw: return 13;
+    case endKw: return 14;
+    case remKw: return 15;
+    default: break;
+    }
+    return argv0.toInt() ? 6 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    //names as they reach isValidVariableName: mostly variables, some keywords and bad names
+    std::vector<QString> names = {"x", "total", "counter", "limit_value", "x1", "_tmp", "i",
+                                  "LET", "MOD", "a_long_variable_name_42", "1abc", "n"};
+    //first words of statements and commands, in the mix of a loaded program
+    std::vector<QString> words = {"LET", "LET", "LET", "PRINT", "PRINT", "IF", "IF", "GOTO",
+                                  "REM", "END", "INPUT", "RUN", "100", "LIST", "HELLO"};
+    long long nameOps = (long long)iterations * names.size();
+    long long wordOps = (long long)iterations * words.size();
+    long long check;
+
+    double ns = measure(nameOps, [&]{
+        long long valid = 0;
+        for(int i = 0; i < iterations; i++)
+            for(const QString& name : names) valid += legacyIsValidVariableName(name);
+        return valid;
+    }, check);
+    printf("%-24s %-8s %8.2f ns/op   (check %lld)\n", "identifier check", "legacy", ns, check);
+    ns = measure(nameOps, [&]{
+        long long valid = 0;
+        for(int i = 0; i < iterations; i++)
+            for(const QString& name : names) valid += isValidName(name);
+        return valid;
+    }, check);
+    printf("%-24s %-8s %8.2f ns/op   (check %lld)\n", "identifier check", "lexicon", ns, check);
+
+    ns = measure(wordOps, [&]{
+        long long sum = 0;
+        for(int i = 0; i < iterations; i++)
+            for(const QString& word : words) sum += legacyDispatch(word);
+        return sum;
+    }, check);
+    printf("%-24s %-8s %8.2f ns/op   (check %lld)\n", "command dispatch", "legacy", ns, check);
+    ns = measure(wordOps, [&]{
+        long long sum = 0;
+        for(int i = 0; i < iterations; i++)
+            for(const QString& word : words) sum += lexiconDispatch(word);
+        return sum;
+    }, check);
+    printf("%-24s %-8s %8.2f ns/op   (check %lld)\n", "command dispatch", "lexicon", ns, check);
+    return 0;
+}
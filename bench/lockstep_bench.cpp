@@ -0,0 +1,106 @@
+/*
+ * lockstep-bench
+ * Throughput of one program over many input sets: microseconds per
+ * instance of separate Program::execute() runs against one lockstep run
+ * of all of them, with the AVX2 kernels and without. The outputs of both
+ * are compared.
+ * Usage: lockstep-bench [instances]
+*/
+#include "program.h"
+#include "lockstep.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static const int repeats = 5;
+
+static void loadProgram(Program& program, const QStringList& lines)
+{
+    program.clear();
+    for(const QString& line : lines){
+        int space = line.indexOf(' ');
+        program.updateStatement(line.left(space).toInt(), line.mid(space + 1));
+    }
+}
+
+/* runScalar
+* Nanoseconds to run the program once per input set; the outputs in results.
+*/
+static qint64 runScalar(Program& program, const std::vector<QStringList>& inputs, std::vector<QString>& results)
+{
+    results.assign(inputs.size(), QString());
+    QElapsedTimer timer;
+    timer.start();
+    for(size_t i = 0; i < inputs.size(); i++){
+        QString input = inputs[i].join("\n") + "\n";
+        QTextStream in(&input);
+        QTextStream out(&results[i]);
+        program.setStreams(&in, &out);
+        program.execute();
+        out.flush();
+    }
+    return timer.nsecsElapsed();
+}
+
+static qint64 runLockstep(Program& program, const std::vector<QStringList>& inputs, std::vector<LockstepResult>& results)
+{
+    QElapsedTimer timer;
+    timer.start();
+    program.executeLockstep(inputs, results);
+    return timer.nsecsElapsed();
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    int instances = argc > 1 ? atoi(argv[1]) : 4096;
+    struct Test
+    {
+        const char* name;
+        QStringList lines;
+        int (*input)(int instance);
+    };
+    const Test tests[] = {
+        //every instance takes the same path
+        {"polynomial", {"10 INPUT x", "20 LET s = 0", "30 FOR i = 1 TO 200",
+                        "40 LET s = (s * 31 + x * i - i * i) MOD 1000003", "50 NEXT i", "60 PRINT s"},
+         [](int instance){ return instance * 7 + 1; }},
+        //the branches and the number of iterations depend on the input
+        {"collatz", {"10 INPUT x", "20 LET c = 0", "30 IF x = 1 THEN 90", "40 IF x MOD 2 = 0 THEN 70",
+                     "50 LET x = 3 * x + 1", "60 GOTO 80", "70 LET x = x / 2", "80 LET c = c + 1",
+                     "85 GOTO 30", "90 PRINT c"},
+         [](int instance){ return instance % 1000 + 1; }},
+    };
+    printf("%d instances, AVX2 %s\n\n", instances, Lockstep::hasAvx2() ? "available" : "not available");
+    for(const Test& test : tests){
+        std::vector<QStringList> inputs;
+        for(int i = 0; i < instances; i++) inputs.push_back({QString::number(test.input(i))});
+        Program program(nullptr, true);
+        loadProgram(program, test.lines);
+        qint64 scalar = -1, vector = -1, plain = -1;
+        std::vector<QString> scalarResults;
+        std::vector<LockstepResult> results;
+        for(int i = 0; i < repeats; i++){
+            qint64 ns = runScalar(program, inputs, scalarResults);
+            if(scalar < 0 || ns < scalar) scalar = ns;
+            Lockstep::setAvx2(true);
+            ns = runLockstep(program, inputs, results);
+            if(vector < 0 || ns < vector) vector = ns;
+            Lockstep::setAvx2(false);
+            ns = runLockstep(program, inputs, results);
+            if(plain < 0 || ns < plain) plain = ns;
+        }
+        Lockstep::setAvx2(true);
+        int mismatches = 0;
+        for(int i = 0; i < instances; i++) mismatches += results[i].output != scalarResults[i] || !results[i].ok;
+        printf("%-10s %8.2f us/instance scalar %8.2f lockstep %8.2f lockstep without AVX2 (%.1fx)%s\n",
+               test.name, scalar / 1000.0 / instances, vector / 1000.0 / instances, plain / 1000.0 / instances,
+               vector > 0 ? double(scalar) / vector : 0.0, mismatches ? "  OUTPUTS DIFFER" : "");
+    }
+    return 0;
+}
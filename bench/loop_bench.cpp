@@ -0,0 +1,89 @@
+/*
+ * loop-bench
+ * Nanoseconds per iteration of loops run by the interpreter, each written
+ * with LET/IF/GOTO ("goto") and with FOR/NEXT ("for").
+ * Usage: loop-bench [iterations]
+*/
+#include "program.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <cstdio>
+#include <cstdlib>
+
+static const int repeats = 5;
+
+struct LoopTest
+{
+    const char* name;
+    QStringList gotoLoop;
+    QStringList forLoop;
+};
+
+/* loadProgram
+* Replace the program by lines ("<line> <statement>"), with %N replaced by n.
+*/
+static void loadProgram(Program& program, const QStringList& lines, int n)
+{
+    program.clear();
+    for(QString line : lines){
+        line.replace("%N", QString::number(n));
+        int space = line.indexOf(' ');
+        program.updateStatement(line.left(space).toInt(), line.mid(space + 1));
+    }
+}
+
+/* measure
+* Best nanoseconds per iteration of the program over repeats runs.
+* output receives what the last run printed.
+*/
+static double measure(const QStringList& lines, int iterations, QString& output)
+{
+    qint64 best = -1;
+    for(int i = 0; i < repeats; i++){
+        output.clear();
+        QTextStream out(&output);
+        Program program(nullptr, true);
+        program.setStreams(nullptr, &out);
+        loadProgram(program, lines, iterations);
+        QElapsedTimer timer;
+        timer.start();
+        program.execute();
+        qint64 ns = timer.nsecsElapsed();
+        out.flush();
+        if(best < 0 || ns < best) best = ns;
+    }
+    return double(best) / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    const LoopTest tests[] = {
+        {"empty loop",
+         {"10 LET i = 1", "20 LET i = i + 1", "30 IF i < %N + 1 THEN 20"},
+         {"10 FOR i = 1 TO %N", "20 NEXT i"}},
+        {"sum",
+         {"10 LET s = 0", "20 LET i = 1", "30 LET s = s + i MOD 7", "40 LET i = i + 1",
+          "50 IF i < %N + 1 THEN 30", "60 PRINT s"},
+         {"10 LET s = 0", "20 FOR i = 1 TO %N", "30 LET s = s + i MOD 7", "40 NEXT i", "50 PRINT s"}},
+        {"array fill",
+         {"10 DIM a(%N)", "20 LET i = 0", "30 LET a(i) = i MOD 7", "40 LET i = i + 1",
+          "50 IF i < %N THEN 30", "60 PRINT a(%N - 1)"},
+         {"10 DIM a(%N)", "20 FOR i = 0 TO %N - 1", "30 LET a(i) = i MOD 7", "40 NEXT i", "50 PRINT a(%N - 1)"}},
+    };
+    printf("%d iterations per loop\n\n", iterations);
+    for(const LoopTest& test : tests){
+        QString gotoOutput, forOutput;
+        double gotoNs = measure(test.gotoLoop, iterations, gotoOutput);
+        double forNs = measure(test.forLoop, iterations, forOutput);
+        printf("%-12s %-6s %8.1f ns/iteration\n", test.name, "goto", gotoNs);
+        printf("%-12s %-6s %8.1f ns/iteration   (x%.2f, output %s)\n", test.name, "for", forNs,
+               forNs > 0 ? gotoNs / forNs : 0.0,
+               gotoOutput == forOutput ? "matches" : "DIFFERS");
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * profiler-bench
+ * Overhead of the sampling profiler: nanoseconds per statement of loops
+ * run without the SIGPROF timer and with it at 1 kHz. The statements still
+ * publish their line and operators when the timer is off, so compare with
+ * a build without QBASIC_ENABLE_PROFILER for the cost of that.
+ * Usage: profiler-bench [iterations] [hz]
+*/
+#include "program.h"
+#include "profiler.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <cstdio>
+#include <cstdlib>
+
+static const int repeats = 7;
+
+/* loadProgram
+* Replace the program by lines ("<line> <statement>"), with %N replaced by n.
+*/
+static void loadProgram(Program& program, const QStringList& lines, int n)
+{
+    program.clear();
+    for(QString line : lines){
+        line.replace("%N", QString::number(n));
+        int space = line.indexOf(' ');
+        program.updateStatement(line.left(space).toInt(), line.mid(space + 1));
+    }
+}
+
+/* run
+* Nanoseconds of one run of the program, sampled at hz (0: not profiled).
+*/
+static qint64 run(const QStringList& lines, int iterations, int hz)
+{
+    QString output;
+    QTextStream out(&output);
+    Program program(nullptr, true);
+    program.setStreams(nullptr, &out);
+    loadProgram(program, lines, iterations);
+    profiler.reset();
+    if(hz > 0) profiler.start(hz);
+    QElapsedTimer timer;
+    timer.start();
+    program.execute();
+    qint64 ns = timer.nsecsElapsed();
+    profiler.stop();
+    return ns;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    int hz = argc > 2 ? atoi(argv[2]) : 1000;
+    if(!Profiler::isSupported()){
+        printf("The profiler is not available in this build\n");
+        return 1;
+    }
+    struct Test
+    {
+        const char* name;
+        QStringList lines;
+        int statements;//per iteration
+    };
+    const Test tests[] = {
+        {"empty loop", {"10 FOR i = 1 TO %N", "20 NEXT i"}, 2},
+        {"arithmetic", {"10 LET s = 0", "20 FOR i = 1 TO %N", "30 LET s = (s + i * 3 - i / 2) MOD 1000", "40 NEXT i"}, 2},
+        {"array fill", {"10 DIM a(%N)", "20 FOR i = 0 TO %N - 1", "30 LET a(i) = i MOD 7", "40 NEXT i"}, 2},
+    };
+    printf("%d iterations, sampled at %d Hz\n\n", iterations, hz);
+    for(const Test& test : tests){
+        //alternate the two so that both see the same machine load
+        qint64 bestOff = -1, bestOn = -1;
+        for(int i = 0; i < repeats; i++){
+            qint64 ns = run(test.lines, iterations, 0);
+            if(bestOff < 0 || ns < bestOff) bestOff = ns;
+            ns = run(test.lines, iterations, hz);
+            if(bestOn < 0 || ns < bestOn) bestOn = ns;
+        }
+        double off = double(bestOff) / ((double)iterations * test.statements);
+        double on = double(bestOn) / ((double)iterations * test.statements);
+        printf("%-12s %8.2f ns/statement off %8.2f on   (%+.1f%%, %llu samples in the last run)\n",
+               test.name, off, on, off > 0 ? 100.0 * (on - off) / off : 0.0,
+               (unsigned long long)profiler.getSamples());
+    }
+    return 0;
+}
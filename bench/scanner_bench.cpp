@@ -0,0 +1,213 @@
+/*
+ * scanner-bench
+ * Throughput (MB of source text per second) of the lexical scanning used when
+ * a program is loaded: splitting lines, collapsing spaces and finding the
+ * runs of the tokenizer. Each test runs the character-at-a-time loops the
+ * loader used before the scanner ("legacy") and the scanner at every level
+ * the CPU supports.
+ * Usage: scanner-bench [lines]
+*/
+#include "scanner.h"
+#include "tokenizer.h"
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+static const int repeats = 5;
+
+/* generateProgram
+* A program with the statement mix of typical test programs, indented and
+* with doubled spaces so that the space collapsing has work to do.
+*/
+static QString generateProgram(int lines)
+{
+    QString text;
+    for(int i = 1; i <= lines; i++){
+        QString line = QString::number(i * 10);
+        switch(i % 10){
+        case 0: line += "  REM   loop counter   and total   of the series"; break;
+        case 1: line += " GOTO " + QString::number(i * 10 + 30); break;
+        case 2: case 3: line += "  PRINT  total_value + counter * (x1 - 42)"; break;
+        case 4: case 5: line += " IF counter  >  limit_value THEN " + QString::number(i * 10 + 10); break;
+        default: line += "   LET  total_value =  total_value + counter MOD 7 - 1024"; break;
+        }
+        text += line + "\n";
+    }
+    return text;
+}
+
+/* measure
+* Best MB/s of work over repeats runs, bytes being the size of the text.
+*/
+static double measure(qint64 bytes, const std::function<long long()>& work, long long& check)
+{
+    qint64 best = -1;
+    for(int i = 0; i < repeats; i++){
+        QElapsedTimer timer;
+        timer.start();
+        check = work();
+        qint64 ns = timer.nsecsElapsed();
+        if(best < 0 || ns < best) best = ns;
+    }
+    return best > 0 ? bytes * 1000.0 / best : 0;
+}
+
+/*
+ * The loops the loader and the tokenizer used before the scanner.
+*/
+static long long legacySplit(const QString& text)
+{
+    long long lines = 0;
+    for(int begin = 0; begin < text.size();){
+        int end = begin;
+        while(end < text.size() && text[end] != '\n') end++;
+        lines += end - begin;
+        begin = end + 1;
+    }
+    return lines;
+}
+
+static long long legacyCollapse(const std::vector<QString>& lines)
+{
+    long long size = 0;
+    for(const QString& s : lines){
+        QString trimmed_s;
+        for(int i = 0; i < s.size(); i++){
+            if(s[i] != ' '||(i>1&&s[i-1] != ' '))
+                trimmed_s += s[i];
+        }
+        size += trimmed_s.size();
+    }
+    return size;
+}
+
+static bool isDigit(QChar c){ return c >= '0' && c <= '9'; }
+static bool isLetter(QChar c){ return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+static long long legacyRuns(const std::vector<QString>& lines)
+{
+    long long runs = 0;
+    for(const QString& s : lines){
+        for(int p = 0; p < s.size(); runs++){
+            while(p < s.size() && s[p].isSpace()) p++;
+            if(p >= s.size()) break;
+            if(isDigit(s[p])) while(p < s.size() && isDigit(s[p])) p++;
+            else if(isLetter(s[p])) while(p < s.size() && (isLetter(s[p]) || s[p] == '_' || isDigit(s[p]))) p++;
+            else p++;
+        }
+    }
+    return runs;
+}
+
+/*
+ * The same work done with the scanner.
+*/
+static long long scannerSplit(const QString& text)
+{
+    long long lines = 0;
+    for(int begin = 0; begin < text.size();){
+        int end = Scanner::findLineBreak(text.constData(), begin, text.size());
+        lines += end - begin;
+        begin = end + 1;
+    }
+    return lines;
+}
+
+static long long scannerCollapse(const std::vector<QString>& lines)
+{
+    long long size = 0;
+    for(const QString& s : lines) size += Scanner::collapseSpaces(s).size();
+    return size;
+}
+
+static long long scannerRuns(const std::vector<QString>& lines)
+{
+    long long runs = 0;
+    for(const QString& s : lines){
+        const QChar* data = s.constData();
+        for(int p = 0; p < s.size(); runs++){
+            p = Scanner::skipBlanks(data, p, s.size());
+            if(p >= s.size()) break;
+            if(isDigit(s[p])) p = Scanner::skipDigits(data, p, s.size());
+            else if(isLetter(s[p])) p = Scanner::skipIdentifier(data, p, s.size());
+            else p++;
+        }
+    }
+    return runs;
+}
+
+static long long tokenizeAll(const std::vector<QString>& expressions)
+{
+    long long count = 0;
+    QVector<Token> tokens;
+    for(const QString& s : expressions){
+        tokens.clear();
+        Status status;
+        Tokenizer(s, nullptr).tokenize(tokens, status);
+        count += tokens.size();
+    }
+    return count;
+}
+
+static void report(const char* test, const char* impl, double mbps, long long check)
+{
+    printf("%-18s %-8s %10.1f MB/s   (check %lld)\n", test, impl, mbps, check);
+}
+
+int main(int argc, char** argv)
+{
+    int lineCount = argc > 1 ? atoi(argv[1]) : 200000;
+    QString text = generateProgram(lineCount);
+    std::vector<QString> lines, expressions;
+    for(int begin = 0; begin < text.size();){
+        int end = Scanner::findLineBreak(text.constData(), begin, text.size());
+        QString line = text.mid(begin, end - begin);
+        int space = line.indexOf(' ');
+        lines.push_back(line.mid(space + 1));
+        if(line.contains("PRINT")) expressions.push_back(line.mid(line.indexOf("PRINT") + 5));
+        else if(line.contains("LET")) expressions.push_back(line.mid(line.indexOf('=') + 1));
+        begin = end + 1;
+    }
+    qint64 textBytes = text.size();
+    qint64 lineBytes = 0, expressionBytes = 0;
+    for(const QString& s : lines) lineBytes += s.size();
+    for(const QString& s : expressions) expressionBytes += s.size();
+    printf("%d lines, %.1f MB of source, best level: %s\n\n",
+           lineCount, textBytes / 1e6, Scanner::levelName(Scanner::bestLevel()));
+
+    long long check;
+    double mbps = measure(textBytes, [&]{ return legacySplit(text); }, check);
+    report("split lines", "legacy", mbps, check);
+    for(int l = Scanner::scalarLevel; l <= Scanner::bestLevel(); l++){
+        Scanner::setLevel(Scanner::Level(l));
+        mbps = measure(textBytes, [&]{ return scannerSplit(text); }, check);
+        report("split lines", Scanner::levelName(Scanner::Level(l)), mbps, check);
+    }
+
+    mbps = measure(lineBytes, [&]{ return legacyCollapse(lines); }, check);
+    report("collapse spaces", "legacy", mbps, check);
+    for(int l = Scanner::scalarLevel; l <= Scanner::bestLevel(); l++){
+        Scanner::setLevel(Scanner::Level(l));
+        mbps = measure(lineBytes, [&]{ return scannerCollapse(lines); }, check);
+        report("collapse spaces", Scanner::levelName(Scanner::Level(l)), mbps, check);
+    }
+
+    mbps = measure(lineBytes, [&]{ return legacyRuns(lines); }, check);
+    report("token runs", "legacy", mbps, check);
+    for(int l = Scanner::scalarLevel; l <= Scanner::bestLevel(); l++){
+        Scanner::setLevel(Scanner::Level(l));
+        mbps = measure(lineBytes, [&]{ return scannerRuns(lines); }, check);
+        report("token runs", Scanner::levelName(Scanner::Level(l)), mbps, check);
+    }
+
+    for(int l = Scanner::scalarLevel; l <= Scanner::bestLevel(); l++){
+        Scanner::setLevel(Scanner::Level(l));
+        mbps = measure(expressionBytes, [&]{ return tokenizeAll(expressions); }, check);
+        report("tokenize", Scanner::levelName(Scanner::Level(l)), mbps, check);
+    }
+    return 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * workload-gen
+ * Writes a synthetic BASIC program for scaling and stress runs, the input
+ * it reads and the output the interpreter prints for it:
+ *   <prefix>.bas, <prefix>.in and <prefix>.out
+ * The same options and seed always give the same files.
+ * Usage: workload-gen <prefix> [--seed <n>] [--lines <n>] [--depth <n>]
+ *                     [--loops <percent>] [--trips <n>] [--body <n>]
+ *                     [--expr-size <n>] [--mix <+>,<->,<*>,</>,<MOD>,<**>]
+ *                     [--repeat <percent>] [--goto <percent>] [--print <percent>]
+ *                     [--vars <n>] [--inputs <n>] [--no-expected]
+ *   --lines      statements of the program
+ *   --depth      FOR loops nested at most
+ *   --loops      statements that open a FOR loop, of --trips iterations
+ *                and at most --body statements
+ *   --expr-size  operands joined by + and - in an expression
+ *   --mix        weights of the operators: + and - join the operands, an
+ *                operand is a pair under * / MOD or ** in the share of
+ *                their weights
+ *   --repeat     operands that repeat one of the last expressions, as
+ *                consecutive statements of real programs do
+ *   --goto       statements that are IF ... THEN or GOTO jumps
+ *   --print      statements that are PRINT
+ *   --vars       variables besides the loop variables
+ *   --inputs     INPUT statements, at the start of the program
+ *   --no-expected  only write the program and the input
+ * Every program runs to its end without an error: values are kept in
+ * 0..999 by a MOD 1000 on every LET, divisors are never 0, jumps only go
+ * forward within the enclosing loop body and loops run a fixed number of
+ * times.
+*/
+#include "program.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Options
+{
+    quint64 seed = 1;
+    int lines = 1000;
+    int depth = 2;
+    int loops = 5;
+    int trips = 3;
+    int body = 8;
+    int exprSize = 4;
+    int repeat = 0;
+    int mix[6] = {4, 2, 3, 1, 1, 1};//+ - * / MOD **
+    int jumps = 5;
+    int prints = 2;
+    int vars = 16;
+    int inputs = 4;
+    bool expected = true;
+};
+
+/*
+ * Generator
+ * Builds the program statement by statement. Open FOR loops are a stack
+ * of blocks, each with the statements it has left; a jump waits in its
+ * block until it has skipped its statements and then targets the next
+ * statement of the block, or the NEXT (the end of the program) that
+ * closes it.
+*/
+class Generator
+{
+public:
+    explicit Generator(const Options& options) : options(options), random(options.seed) {}
+    void generate();
+    std::vector<std::string> lines;
+    std::vector<int> input;
+
+private:
+    static const int chunkTerms = 1024;//operands summed before a MOD, below 2^31 / 999^2
+    struct Jump
+    {
+        int line;//index in lines
+        int skip;//statements of the block left to skip
+    };
+    struct Block
+    {
+        int remaining;//statements left to generate
+        std::vector<Jump> jumps;
+    };
+    const Options& options;
+    std::mt19937_64 random;
+    std::vector<Block> blocks;
+    std::vector<std::string> recent;//the last expressions without repeated operands
+    bool repeated = false;//the expression being built has one
+    int below(int n) { return n > 0 ? int(random() % quint64(n)) : 0; }
+    static std::string number(int line) { return std::to_string((line + 1) * 10); }
+    std::string variable();
+    std::string operand();
+    std::string term();
+    std::string sum(int terms);
+    std::string expression();
+    std::string condition();
+    void startStatement();
+    void add(const std::string& statement);
+    void closeBlock(int targetLine);
+};
+
+/* Generator::variable
+* A variable of the program or of an enclosing FOR loop.
+*/
+std::string Generator::variable()
+{
+    int loopVariables = int(blocks.size()) - 1;
+    int choice = below(options.vars + loopVariables);
+    if(choice < options.vars) return "v" + std::to_string(choice);
+    return "i" + std::to_string(choice - options.vars);
+}
+
+/* Generator::operand
+* A variable, or a number one time in four; both are in 0..999.
+*/
+std::string Generator::operand()
+{
+    if(below(4) == 0) return std::to_string(below(1000));
+    return variable();
+}
+
+/* Generator::term
+* An operand, or a pair of them under a multiplicative operator with the
+* weights of the mix; at most 999^2. --repeat of them are one of the
+* recent expressions.
+*/
+std::string Generator::term()
+{
+    if(!recent.empty() && below(100) < options.repeat){
+        repeated = true;
+        return recent[below(recent.size())];
+    }
+    const int* mix = options.mix;
+    int total = mix[0] + mix[1] + mix[2] + mix[3] + mix[4] + mix[5];
+    int choice = below(total) - mix[0] - mix[1];
+    if(choice < 0) return operand();
+    std::string left = operand();
+    if((choice -= mix[2]) < 0) return left + " * " + operand();
+    if((choice -= mix[3]) < 0) return left + " / " + (below(2) ? std::to_string(1 + below(99)) : "(" + variable() + " + 1)");
+    if((choice -= mix[4]) < 0) return left + " MOD " + std::to_string(1 + below(99));
+    return left + " ** " + std::to_string(below(3));
+}
+
+/* Generator::sum
+* terms terms joined by + and - with the weights of the mix.
+*/
+std::string Generator::sum(int terms)
+{
+    int additive = options.mix[0] + options.mix[1];
+    std::string text = term();
+    for(int i = 1; i < terms; i++){
+        text += below(additive) < options.mix[0] ? " + " : " - ";
+        text += term();
+    }
+    return text;
+}
+
+/* Generator::expression
+* --expr-size terms in 0..999: sums of at most chunkTerms, each MOD 1000.
+* It becomes one of the recent expressions unless it repeats one, so that
+* repeated expressions do not nest.
+*/
+std::string Generator::expression()
+{
+    static const size_t recentCount = 4;
+    int terms = options.exprSize;
+    std::string text;
+    repeated = false;
+    if(terms <= chunkTerms) text = "(" + sum(terms) + ") MOD 1000";
+    else{
+        text = "(";
+        for(int done = 0; done < terms; done += chunkTerms){
+            if(done > 0) text += " + ";
+            text += "(" + sum(std::min(chunkTerms, terms - done)) + ") MOD 1000";
+        }
+        text += ") MOD 1000";
+    }
+    if(options.repeat > 0 && !repeated){
+        if(recent.size() == recentCount) recent.erase(recent.begin());
+        recent.push_back(text);
+    }
+    return text;
+}
+
+std::string Generator::condition()
+{
+    static const char* const comparisons[] = {" = ", " < ", " > "};
+    return sum(1 + below(2)) + comparisons[below(3)] + sum(1 + below(2));
+}
+
+/* Generator::startStatement
+* The line about to be added starts a statement of the innermost block:
+* it is the target of the jumps of the block that skipped enough.
+*/
+void Generator::startStatement()
+{
+    std::vector<Jump>& jumps = blocks.back().jumps;
+    int target = int(lines.size());
+    size_t kept = 0;
+    for(Jump& jump : jumps){
+        if(jump.skip-- == 0) lines[jump.line] += number(target);
+        else jumps[kept++] = jump;
+    }
+    jumps.resize(kept);
+}
+
+void Generator::add(const std::string& statement)
+{
+    lines.push_back(number(int(lines.size())) + " " + statement);
+}
+
+/* Generator::closeBlock
+* Point the jumps left in the innermost block at targetLine and drop it.
+*/
+void Generator::closeBlock(int targetLine)
+{
+    for(const Jump& jump : blocks.back().jumps) lines[jump.line] += number(targetLine);
+    blocks.pop_back();
+}
+
+/* Generator::generate
+* The INPUT statements and the LETs of the variables they leave undefined,
+* then the statements, then a PRINT of the sum of the variables.
+*/
+void Generator::generate()
+{
+    for(int i = 0; i < options.inputs; i++){
+        add("INPUT v" + std::to_string(i % options.vars));
+        input.push_back(below(1000));
+    }
+    for(int i = options.inputs; i < options.vars; i++) add("LET v" + std::to_string(i) + " = " + std::to_string(below(1000)));
+    int body = options.lines - int(lines.size()) - 1;
+    blocks.push_back({std::max(body, 0), {}});
+    while(true){
+        Block& block = blocks.back();
+        if(block.remaining == 0){
+            if(blocks.size() == 1) break;
+            int loop = int(blocks.size()) - 2;
+            closeBlock(int(lines.size()));
+            add("NEXT i" + std::to_string(loop));
+            continue;
+        }
+        startStatement();
+        int choice = below(100);
+        int loop = int(blocks.size()) - 1;
+        if(loop < options.depth && block.remaining >= 3 && choice < options.loops){
+            int statements = 1 + below(std::min(options.body, block.remaining - 2));
+            block.remaining -= statements + 2;
+            add("FOR i" + std::to_string(loop) + " = 1 TO " + std::to_string(options.trips));
+            blocks.push_back({statements, {}});
+            continue;
+        }
+        block.remaining--;
+        if((choice -= options.loops) < options.jumps){
+            add(below(4) ? "IF " + condition() + " THEN " : "GOTO ");
+            block.jumps.push_back({int(lines.size()) - 1, 1 + below(4)});
+        }
+        else if((choice -= options.jumps) < options.prints) add("PRINT " + expression());
+        else add("LET v" + std::to_string(below(options.vars)) + " = " + expression());
+    }
+    closeBlock(int(lines.size()));
+    std::string total = "v0";
+    for(int i = 1; i < options.vars; i++) total += " + v" + std::to_string(i);
+    add("PRINT " + total);
+}
+
+/* parseOptions
+* Read the options of args after the prefix. Return false on an unknown
+* option or a value out of range.
+*/
+static bool parseOptions(const QStringList& args, Options& options)
+{
+    for(int i = 2; i < args.size(); i++){
+        const QString& arg = args[i];
+        if(arg == "--no-expected"){
+            options.expected = false;
+            continue;
+        }
+        if(i + 1 >= args.size()) return false;
+        const QString& value = args[++i];
+        if(arg == "--seed") options.seed = value.toULongLong();
+        else if(arg == "--lines") options.lines = value.toInt();
+        else if(arg == "--depth") options.depth = value.toInt();
+        else if(arg == "--loops") options.loops = value.toInt();
+        else if(arg == "--trips") options.trips = value.toInt();
+        else if(arg == "--body") options.body = value.toInt();
+        else if(arg == "--expr-size") options.exprSize = value.toInt();
+        else if(arg == "--repeat") options.repeat = value.toInt();
+        else if(arg == "--goto") options.jumps = value.toInt();
+        else if(arg == "--print") options.prints = value.toInt();
+        else if(arg == "--vars") options.vars = value.toInt();
+        else if(arg == "--inputs") options.inputs = value.toInt();
+        else if(arg == "--mix"){
+            QStringList weights = value.split(',');
+            if(weights.size() != 6) return false;
+            for(int w = 0; w < 6; w++) options.mix[w] = weights[w].toInt();
+        }
+        else return false;
+    }
+    const int* mix = options.mix;
+    for(int w = 0; w < 6; w++) if(mix[w] < 0) return false;
+    return options.lines > 0 && options.depth >= 0
+        && options.trips >= 1 && options.trips <= 999 && options.body >= 1 && options.exprSize >= 1
+        && options.repeat >= 0 && options.loops >= 0 && options.jumps >= 0 && options.prints >= 0
+        && options.loops + options.jumps + options.prints <= 100
+        && options.vars >= 1 && options.inputs >= 0 && mix[0] + mix[1] > 0;
+}
+
+static bool writeFile(const std::string& name, const std::string& text)
+{
+    FILE* file = fopen(name.c_str(), "wb");
+    if(!file) return false;
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && ok;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QStringList args;
+    for(int i = 0; i < argc; i++) args << QString::fromLocal8Bit(argv[i]);
+    Options options;
+    if(args.size() < 2 || args[1].startsWith("--") || !parseOptions(args, options)){
+        fprintf(stderr, "usage: workload-gen <prefix> [--seed <n>] [--lines <n>] [--depth <n>] [--loops <percent>]\n"
+                        "                    [--trips <n>] [--body <n>] [--expr-size <n>] [--mix <weights of + - * / MOD **>]\n"
+                        "                    [--repeat <percent>] [--goto <percent>] [--print <percent>] [--vars <n>] [--inputs <n>]\n"
+                        "                    [--no-expected]\n");
+        return 2;
+    }
+    std::string prefix = args[1].toStdString();
+    QElapsedTimer timer;
+    timer.start();
+    Generator generator(options);
+    generator.generate();
+    std::string program, input;
+    for(const std::string& line : generator.lines) (program += line) += '\n';
+    for(int value : generator.input) (input += std::to_string(value)) += '\n';
+    if(!writeFile(prefix + ".bas", program) || !writeFile(prefix + ".in", input)){
+        fprintf(stderr, "workload-gen: can not write %s.bas or %s.in\n", prefix.c_str(), prefix.c_str());
+        return 1;
+    }
+    fprintf(stderr, "%zu lines generated in %lld ms\n", generator.lines.size(), (long long)timer.elapsed());
+    if(!options.expected) return 0;
+
+    //the expected output is what the interpreter prints
+    timer.restart();
+    QString inputText = QString::fromStdString(input), output, errors;
+    QTextStream in(&inputText), out(&output), err(&errors);
+    Program interpreter(nullptr, true);
+    interpreter.setStreams(&in, &out, &err);
+    for(size_t i = 0; i < generator.lines.size(); i++){
+        const std::string& line = generator.lines[i];
+        size_t space = line.find(' ');
+        if(!interpreter.updateStatement(int(i + 1) * 10, QString::fromStdString(line.substr(space + 1)))){
+            err.flush();
+            fprintf(stderr, "workload-gen: line %s does not parse\n%s", line.c_str(), errors.toLocal8Bit().constData());
+            return 1;
+        }
+    }
+    qint64 loadMs = timer.restart();
+    bool ok = interpreter.execute();
+    out.flush();
+    err.flush();
+    if(!ok || !errors.isEmpty()){
+        fprintf(stderr, "workload-gen: the program fails\n%s", errors.toLocal8Bit().constData());
+        return 1;
+    }
+    if(!writeFile(prefix + ".out", output.toStdString())){
+        fprintf(stderr, "workload-gen: can not write %s.out\n", prefix.c_str());
+        return 1;
+    }
+    fprintf(stderr, "loaded in %lld ms, run in %lld ms\n", (long long)loadMs, (long long)timer.elapsed());
+    return 0;
+}
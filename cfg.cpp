@@ -0,0 +1,746 @@
+#include "cfg.h"
+#include "statement.h"
+#include <QQueue>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+//Values are ints: a range that leaves the int range may wrap to any value.
+static const long long minValue = std::numeric_limits<int>::min();
+static const long long maxValue = std::numeric_limits<int>::max();
+//Joins at a block after which its growing ranges are widened.
+static const int widenAfter = 3;
+//Largest blocks * variables proveBounds keeps states for.
+static const long long maxStateCells = 1 << 22;
+
+/* ControlFlowGraph::finalTarget
+* Follow a jump to line: skip lines that do nothing (REM) and lines that
+* only jump further (GOTO), and return the first line that does real work.
+* Jumps to missing lines and GOTO cycles are left untouched so that
+* they fail (or loop) on the same line as before.
+*/
+int ControlFlowGraph::finalTarget(StatementTable& statements, int line) const
+{
+    int current = line;
+    for(int steps = 0; steps <= statements.size(); steps++){
+        int index = statements.indexOf(current);
+        if(index < 0) return current;
+        Statement& st = statements[index];
+        if(st.type == StatementType::gotoStmt){
+            if(statements.indexOf(st.jumpLine) < 0) return current;
+            current = st.jumpLine;
+        }
+        else if(st.type == StatementType::remStmt || st.type == StatementType::unknownStmt){
+            if(index + 1 == statements.size()) return current;
+            current = statements[index + 1].line;
+        }
+        else return current;
+    }
+    return line;
+}
+
+/* ControlFlowGraph::matchLoops
+* Pair every NEXT with its FOR: the innermost FOR before it that is not
+* closed yet and counts the variable of the NEXT (any variable for a NEXT
+* without one). Both get the line of the other as target. FOR jumps to the
+* line after its NEXT when its loop runs no iteration (0: the end of the
+* program), NEXT jumps to the line after its FOR for the next iteration.
+* A FOR or NEXT without partner keeps target 0 and fails when executed.
+* Return the number of loops.
+*/
+int ControlFlowGraph::matchLoops(StatementTable& statements)
+{
+    int n = statements.size();
+    int loops = 0;
+    QVector<int> open;//indices of the FOR statements not closed yet
+    for(int i = 0; i < n; i++){
+        Statement& st = statements[i];
+        if(st.type != StatementType::forStmt && st.type != StatementType::nextStmt) continue;
+        st.target = 0;
+        st.jumpLine = 0;
+        if(st.type == StatementType::forStmt){
+            open.push_back(i);
+            continue;
+        }
+        int k = open.size() - 1;
+        if(st.varSlot >= 0)
+            while(k >= 0 && statements[open[k]].varSlot != st.varSlot) k--;
+        if(k < 0) continue;
+        Statement& loop = statements[open[k]];
+        loop.target = st.line;
+        loop.jumpLine = i + 1 < n ? statements[i + 1].line : 0;
+        st.target = loop.line;
+        st.jumpLine = statements[open[k] + 1].line;
+        open.resize(k);//FORs opened inside the loop stay unmatched
+        loops++;
+    }
+    return loops;
+}
+
+/* ControlFlowGraph::resetJumps
+* Point every GOTO, IF and GOSUB back at the line it names. The threading
+* of an earlier plan is kept with the parsed statements, but the lines it
+* went through may have changed since, and a debug run does not thread.
+*/
+void ControlFlowGraph::resetJumps(StatementTable& statements)
+{
+    for(Statement& st : statements)
+        if(st.type == StatementType::gotoStmt || st.type == StatementType::ifStmt
+                || st.type == StatementType::gosubStmt) st.jumpLine = st.target;
+}
+
+/* ControlFlowGraph::threadJumps
+* Point every GOTO, IF and GOSUB directly at the final target of its jump
+* chain. Return the number of rewritten jumps.
+*/
+int ControlFlowGraph::threadJumps(StatementTable& statements)
+{
+    threaded = 0;
+    for(Statement& st : statements){
+        if(st.type != StatementType::gotoStmt && st.type != StatementType::ifStmt
+                && st.type != StatementType::gosubStmt) continue;
+        int target = finalTarget(statements, st.jumpLine);
+        if(target != st.jumpLine){
+            st.jumpLine = target;
+            threaded++;
+        }
+    }
+    return threaded;
+}
+
+/* ControlFlowGraph::build
+* Split the statements into basic blocks, connect them and mark the
+* blocks reachable from entryLine (the first line of a normal run).
+* activeCalls are the lines of the GOSUBs whose calls are active when a
+* resumed run starts: their RETURNs continue after them.
+*/
+void ControlFlowGraph::build(StatementTable& statements, int entryLine, const QVector<int>& activeCalls)
+{
+    int n = statements.size();
+    blocks.clear();
+    entryBlocks.clear();
+    blockOf.fill(-1, n);
+    lineOf.resize(n);
+    unreachableLines.clear();
+    if(n == 0) return;
+
+    //Step1. A block starts at the first line, at the entry lines, at every
+    //jump target and after every jump, END and RETURN.
+    QVector<bool> leader(n, false);
+    int entry = statements.indexOf(entryLine);
+    QVector<int> entries(1, entry >= 0 ? entry : 0);
+    for(int line : activeCalls){
+        int index = statements.indexOf(line);
+        if(index >= 0 && index + 1 < n) entries.push_back(index + 1);
+    }
+    for(int i : entries) leader[i] = true;
+    bool startsBlock = true;
+    for(int i = 0; i < n; i++){
+        Statement& st = statements[i];
+        lineOf[i] = st.line;
+        if(startsBlock) leader[i] = true;
+        startsBlock = st.isJump() || st.type == StatementType::endStmt || st.type == StatementType::returnStmt;
+        if(st.isJump()){
+            int target = statements.indexOf(st.jumpLine);
+            if(target >= 0) leader[target] = true;
+        }
+    }
+
+    //Step2. Collect the blocks.
+    for(int i = 0; i < n; i++){
+        if(leader[i]){
+            BasicBlock block;
+            block.first = i;
+            block.last = i;
+            block.reachable = false;
+            blocks.push_back(block);
+        }
+        blocks.back().last = i;
+        blockOf[i] = blocks.size() - 1;
+    }
+
+    //Step3. Connect each block to the targets of its last statement.
+    for(int b = 0; b < blocks.size(); b++){
+        Statement& last = statements[blocks[b].last];
+        if(last.isJump()){
+            int target = statements.indexOf(last.jumpLine);
+            if(target >= 0) blocks[b].successors.push_back(blockOf[target]);
+        }
+        bool fallsThrough = last.type != StatementType::gotoStmt && last.type != StatementType::endStmt
+                && last.type != StatementType::returnStmt;
+        if(fallsThrough && b + 1 < blocks.size() && !blocks[b].successors.contains(b + 1))
+            blocks[b].successors.push_back(b + 1);
+    }
+
+    //Step4. Mark the blocks reachable from the entry blocks.
+    QQueue<int> q;
+    for(int i : entries){
+        int b = blockOf[i];
+        if(blocks[b].reachable) continue;
+        entryBlocks.push_back(b);
+        blocks[b].reachable = true;
+        q.enqueue(b);
+    }
+    while(!q.isEmpty()){
+        int b = q.dequeue();
+        for(int next : blocks[b].successors){
+            if(!blocks[next].reachable){
+                blocks[next].reachable = true;
+                q.enqueue(next);
+            }
+        }
+    }
+    for(int i = 0; i < n; i++){
+        if(!blocks[blockOf[i]].reachable) unreachableLines.push_back(lineOf[i]);
+    }
+}
+
+/* ControlFlowGraph::isReachable
+* Check if the statement with the given index can be executed at all.
+*/
+bool ControlFlowGraph::isReachable(int index) const
+{
+    return index >= 0 && index < blockOf.size() && blocks[blockOf[index]].reachable;
+}
+
+/* ControlFlowGraph::report
+* Show the blocks, their edges and the unreachable lines.
+*/
+QString ControlFlowGraph::report() const
+{
+    QString res = QString("CFG: %1 statements, %2 blocks, %3 threaded jumps, %4 unreachable statements\n")
+            .arg(lineOf.size()).arg(blocks.size()).arg(threaded).arg(unreachableLines.size());
+    for(int i = 0; i < blocks.size(); i++){
+        const BasicBlock& block = blocks[i];
+        res += "B" + QString::number(i) + " [" + QString::number(lineOf[block.first]);
+        if(block.last != block.first) res += "-" + QString::number(lineOf[block.last]);
+        res += "]";
+        if(!block.successors.isEmpty()){
+            res += " ->";
+            for(int next : block.successors) res += " B" + QString::number(next);
+        }
+        if(!block.reachable) res += " (unreachable)";
+        res += "\n";
+    }
+    if(elementAccesses > 0)
+        res += QString("array accesses: %1, %2 proven in range\n").arg(elementAccesses).arg(boundsProven);
+    if(subexpressionsShared > 0)
+        res += QString("common subexpressions: %1, in %2 places\n").arg(subexpressionsShared).arg(sharedOccurrences);
+    if(!unreachableLines.isEmpty()){
+        res += "unreachable lines:";
+        for(int line : unreachableLines) res += " " + QString::number(line);
+        res += "\n";
+    }
+    return res;
+}
+
+/*------Bounds of array indices------*/
+
+/* ControlFlowGraph::rangeOf
+* The values the tape entries first ... last - 1 can compute in state: the
+* tape is run on ranges instead of values. An element can be anything.
+*/
+ValueRange ControlFlowGraph::rangeOf(const TapeEntry* first, const TapeEntry* last, const RangeState& state) const
+{
+    const ValueRange any = {minValue, maxValue};
+    ranges.clear();
+    for(const TapeEntry* entry = first; entry != last; entry++){
+        switch(entry->op){
+        case numberOp:
+            ranges.push_back({entry->node->value, entry->node->value});
+            break;
+        case variableOp:
+            ranges.push_back(state.values[entry->operand]);
+            break;
+        case elementOp:
+            ranges.back() = any;
+            break;
+        case operationOp:{
+            ValueRange r = ranges.back();
+            ranges.pop_back();
+            ranges.back() = combine(entry->opt, ranges.back(), r);
+            break;
+        }
+        case operationNumberOp:
+            ranges.back() = combine(entry->opt, ranges.back(), {entry->node->right->value, entry->node->right->value});
+            break;
+        case operationVariableOp:
+            ranges.back() = combine(entry->opt, ranges.back(), state.values[entry->operand]);
+            break;
+        case memoOp:
+            break;
+        }
+    }
+    return ranges.back();
+}
+
+ValueRange ControlFlowGraph::rangeOf(const Expression* exp, const RangeState& state) const
+{
+    return rangeOf(exp->tape.data(), exp->tape.data() + exp->tape.size(), state);
+}
+
+/* ControlFlowGraph::combine
+* The values l opt r can take.
+*/
+ValueRange ControlFlowGraph::combine(ExpOperation opt, ValueRange l, ValueRange r) const
+{
+    const ValueRange any = {minValue, maxValue};
+    ValueRange res = any;
+    switch(opt){
+    case ExpOperation::add:
+        res = {l.lo + r.lo, l.hi + r.hi};
+        break;
+    case ExpOperation::sub:
+        res = {l.lo - r.hi, l.hi - r.lo};
+        break;
+    case ExpOperation::mul:{
+        long long p[4] = {l.lo * r.lo, l.lo * r.hi, l.hi * r.lo, l.hi * r.hi};
+        res = {*std::min_element(p, p + 4), *std::max_element(p, p + 4)};
+        break;
+    }
+    case ExpOperation::divide:
+        //division by a positive divisor is monotonic in both operands
+        if(r.lo > 0){
+            long long q[4] = {l.lo / r.lo, l.lo / r.hi, l.hi / r.lo, l.hi / r.hi};
+            res = {*std::min_element(q, q + 4), *std::max_element(q, q + 4)};
+        }
+        break;
+    case ExpOperation::mod:
+        //the result has the sign of the divisor, see Expression::myMod
+        if(r.lo > 0) res = {0, r.hi - 1};
+        else if(r.hi < 0) res = {r.lo + 1, 0};
+        break;
+    default:
+        break;
+    }
+    if(res.lo < minValue || res.hi > maxValue) return any;
+    return res;
+}
+
+/* ControlFlowGraph::transfer
+* Update state by the effect of executing st. The limit and step of a
+* FOR are kept in the state slots of its loop for its NEXT.
+*/
+void ControlFlowGraph::transfer(const Statement& st, RangeState& state) const
+{
+    switch(st.type){
+    case StatementType::forStmt:{
+        int limitSlot = loopRanges.value(st.line).limitSlot;
+        ValueRange start = rangeOf(st.expressions[0], state);
+        state.values[limitSlot] = rangeOf(st.expressions[1], state);
+        state.values[limitSlot + 1] = st.expressions[2] ? rangeOf(st.expressions[2], state) : ValueRange{1, 1};
+        state.values[st.varSlot] = start;
+        state.sizes[st.varSlot] = 0;
+        break;
+    }
+    case StatementType::letStmt:
+        if(st.expressions[1] != nullptr) return;//an element: no variable changes
+        state.values[st.varSlot] = rangeOf(st.expressions[0], state);
+        state.sizes[st.varSlot] = 0;
+        break;
+    case StatementType::inputStmt:
+        state.values[st.varSlot] = {minValue, maxValue};
+        state.sizes[st.varSlot] = 0;
+        break;
+    case StatementType::dimStmt:{
+        ValueRange size = rangeOf(st.expressions[0], state);
+        state.values[st.varSlot] = {minValue, maxValue};
+        state.sizes[st.varSlot] = size.lo > 0 ? size.lo : 0;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/* ControlFlowGraph::refine
+* Narrow state by the condition of the jump statement st, knowing whether
+* the jump is taken; state is no longer reached if the condition cannot
+* have that outcome.
+* IF: a side of the condition that is a variable gets the range allowed
+* by the other side. FOR and NEXT: the counter is within the limit of the
+* loop inside it and past the limit after it, NEXT also adds the step.
+* The step is only used when its sign is known.
+*/
+void ControlFlowGraph::refine(const Statement& st, bool taken, RangeState& state) const
+{
+    if(st.type == StatementType::forStmt || st.type == StatementType::nextStmt){
+        if(st.target == 0) return;//unmatched: fails when executed
+        LoopRanges loop = loopRanges.value(st.type == StatementType::forStmt ? st.line : st.target);
+        ValueRange limit = state.values[loop.limitSlot];
+        ValueRange step = state.values[loop.limitSlot + 1];
+        ValueRange x = state.values[loop.counter];
+        if(st.type == StatementType::nextStmt) x = {x.lo + step.lo, x.hi + step.hi};
+        //FOR jumps when the loop runs no iteration, NEXT when it runs one more
+        bool inside = st.type == StatementType::forStmt ? !taken : taken;
+        if(step.lo >= 0){
+            if(inside) x.hi = std::min(x.hi, limit.hi);
+            else x.lo = std::max(x.lo, limit.lo + 1);
+        }
+        else if(step.hi < 0){
+            if(inside) x.lo = std::max(x.lo, limit.lo);
+            else x.hi = std::min(x.hi, limit.hi - 1);
+        }
+        if(x.lo > x.hi) state.reached = false;
+        else if(x.lo < minValue || x.hi > maxValue) x = {minValue, maxValue};
+        state.values[loop.counter] = x;
+        return;
+    }
+    const ExpressionNode* sides[2] = {st.expressions[0]->root, st.expressions[1]->root};
+    ValueRange ranges[2] = {rangeOf(st.expressions[0], state), rangeOf(st.expressions[1], state)};
+    for(int i = 0; i < 2; i++){
+        if(sides[i]->type != ExpNodeType::variable) continue;
+        ValueRange& x = state.values[sides[i]->slot];
+        ValueRange other = ranges[1 - i];
+        char op = st.condOpt;
+        if(i == 1 && op != '=') op = op == '<' ? '>' : '<';//e < x is x > e
+        if(op == '<'){
+            if(taken) x.hi = std::min(x.hi, other.hi - 1);
+            else x.lo = std::max(x.lo, other.lo);
+        }
+        else if(op == '>'){
+            if(taken) x.lo = std::max(x.lo, other.lo + 1);
+            else x.hi = std::min(x.hi, other.hi);
+        }
+        else if(taken){
+            x.lo = std::max(x.lo, other.lo);
+            x.hi = std::min(x.hi, other.hi);
+        }
+        if(x.lo > x.hi) state.reached = false;
+    }
+}
+
+/* ControlFlowGraph::join
+* Merge the state of another incoming edge into into. With widen, a bound
+* that grows moves on to the next constant of the program (or the end of
+* the int range) so that loops reach a fixed point quickly.
+* Return true if into changed.
+*/
+bool ControlFlowGraph::join(RangeState& into, const RangeState& from, bool widen) const
+{
+    bool changed = false;
+    for(int i = 0; i < into.values.size(); i++){
+        ValueRange& x = into.values[i];
+        const ValueRange& y = from.values[i];
+        if(y.lo < x.lo){
+            x.lo = y.lo;
+            if(widen){
+                auto it = std::upper_bound(thresholds.begin(), thresholds.end(), y.lo);
+                x.lo = it == thresholds.begin() ? minValue : *(it - 1);
+            }
+            changed = true;
+        }
+        if(y.hi > x.hi){
+            x.hi = y.hi;
+            if(widen){
+                auto it = std::lower_bound(thresholds.begin(), thresholds.end(), y.hi);
+                x.hi = it == thresholds.end() ? maxValue : *it;
+            }
+            changed = true;
+        }
+        if(from.sizes[i] < into.sizes[i]){
+            into.sizes[i] = from.sizes[i];
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/* ControlFlowGraph::markElements
+* Mark the element nodes of an expression whose index is in range in
+* state. With a null state, clear the marks and collect the constants of
+* the expression into thresholds instead. Return the number of element
+* nodes marked (or cleared).
+* The index of an element is the tape from the memoOp of the element to
+* the element entry.
+*/
+int ControlFlowGraph::markElements(Expression* exp, const RangeState* state)
+{
+    int count = 0;
+    const TapeEntry* tape = exp->tape.data();
+    starts.clear();
+    for(int pc = 0; pc < (int)exp->tape.size(); pc++){
+        const TapeEntry& entry = tape[pc];
+        if(entry.op == memoOp) starts.push_back(pc);
+        const ExpressionNode* number = entry.op == numberOp ? entry.node
+                                     : entry.op == operationNumberOp ? entry.node->right : nullptr;
+        if(number != nullptr && state == nullptr)
+            for(long long v = number->value - 1; v <= number->value + 1; v++) thresholds.push_back(v);
+        if(entry.op == memoOp || !entry.memoized) continue;
+        int start = starts.back();
+        starts.pop_back();
+        if(entry.op != elementOp) continue;
+        if(state == nullptr){
+            entry.node->indexProven = false;
+            count++;
+            continue;
+        }
+        ValueRange index = rangeOf(tape + start + 1, tape + pc, *state);
+        entry.node->indexProven = index.lo >= 0 && index.hi < state->sizes[entry.node->slot];
+        count += entry.node->indexProven;
+    }
+    return count;
+}
+
+/* ControlFlowGraph::proveBounds
+* Find the array accesses whose index is in range on every execution and
+* let them skip the bounds check. Call after build(); variableCount is the
+* number of variable slots of the program.
+* The ranges of the variables are propagated over the blocks, starting
+* with nothing known at the entry blocks and after every GOSUB (its
+* subroutine may change any variable), until they no longer change.
+* An IF narrows the variables it compares on each of its two edges, so
+* the counter of a loop that ends with IF i < n THEN has a bounded range
+* inside the loop. Programs without DIM are skipped, as are programs too
+* big to keep a state per block.
+* Return the number of accesses proven in range.
+*/
+int ControlFlowGraph::proveBounds(StatementTable& statements, int variableCount)
+{
+    //forget the marks of the last run, collect the constants to widen to
+    elementAccesses = 0;
+    boundsProven = 0;
+    thresholds.clear();
+    loopRanges.clear();
+    bool hasArrays = false;
+    int stateSlots = variableCount;//the variables, then limit and step of every loop
+    for(Statement& st : statements){
+        if(st.type == StatementType::dimStmt) hasArrays = true;
+        if(st.type == StatementType::forStmt){
+            loopRanges.insert(st.line, LoopRanges{stateSlots, st.varSlot});
+            stateSlots += 2;
+        }
+        for(Expression* exp : st.expressions) if(exp) elementAccesses += markElements(exp, nullptr);
+    }
+    if(!hasArrays || elementAccesses == 0 || blocks.isEmpty()
+            || (long long)blocks.size() * stateSlots > maxStateCells) return 0;
+    std::sort(thresholds.begin(), thresholds.end());
+    thresholds.erase(std::unique(thresholds.begin(), thresholds.end()), thresholds.end());
+
+    //Step1. Propagate the states over the edges to a fixed point.
+    QVector<RangeState> in(blocks.size());
+    QVector<int> joins(blocks.size(), 0);
+    QVector<bool> queued(blocks.size(), false);
+    QQueue<int> q;
+    auto propagate = [&](int to, const RangeState& state){
+        if(!state.reached) return;
+        bool changed = true;
+        if(!in[to].reached) in[to] = state;
+        else changed = join(in[to], state, ++joins[to] > widenAfter);
+        if(changed && !queued[to]){
+            queued[to] = true;
+            q.enqueue(to);
+        }
+    };
+    RangeState initial;
+    initial.reached = true;
+    initial.values.fill({minValue, maxValue}, stateSlots);
+    initial.sizes.fill(0, stateSlots);
+    for(int b : entryBlocks) propagate(b, initial);
+    while(!q.isEmpty()){
+        int b = q.dequeue();
+        queued[b] = false;
+        RangeState state = in[b];
+        for(int i = blocks[b].first; i <= blocks[b].last; i++) transfer(statements[i], state);
+        Statement& last = statements[blocks[b].last];
+        int target = -1;
+        if(last.isJump()){
+            int index = statements.indexOf(last.jumpLine);
+            if(index >= 0) target = blockOf[index];
+        }
+        if(last.type == StatementType::gosubStmt){
+            //the subroutine may change anything before it returns
+            if(target >= 0) propagate(target, state);
+            state = initial;
+        }
+        else if(last.isJump() && last.type != StatementType::gotoStmt){
+            RangeState taken = state;
+            refine(last, true, taken);
+            if(target >= 0) propagate(target, taken);
+            refine(last, false, state);
+        }
+        if(last.type == StatementType::gotoStmt){
+            if(target >= 0) propagate(target, state);
+        }
+        else if(last.type != StatementType::endStmt && last.type != StatementType::returnStmt
+                && b + 1 < blocks.size()){
+            propagate(b + 1, state);
+        }
+    }
+
+    //Step2. Mark the accesses with the state before their statement.
+    for(int b = 0; b < blocks.size(); b++){
+        if(!in[b].reached) continue;
+        RangeState state = in[b];
+        for(int i = blocks[b].first; i <= blocks[b].last; i++){
+            for(Expression* exp : statements[i].expressions)
+                if(exp) boundsProven += markElements(exp, &state);
+            transfer(statements[i], state);
+        }
+    }
+    return boundsProven;
+}
+
+/*------Common subexpressions------*/
+
+namespace {
+/* The value of a subtree: a number and a variable are their own value
+ * (their number or slot, tagged), an element or an operation gets a value
+ * number from its key, the array or operator and the values of its
+ * operands.*/
+enum ValueTag { innerTag, numberTag, variableTag };
+inline qint64 taggedValue(ValueTag tag, qint64 n) { return n * 4 + tag; }
+struct ValueKey
+{
+    int kind;//the array slot of an element, -1 - the operator of an operation
+    qint64 left;
+    qint64 right;
+    bool operator==(const ValueKey& other) const
+    {
+        return kind == other.kind && left == other.left && right == other.right;
+    }
+};
+struct ValueKeyHash
+{
+    size_t operator()(const ValueKey& key) const
+    {
+        quint64 h = quint64(key.left) * 0x9E3779B97F4A7C15ull ^ quint64(key.right);
+        h = (h ^ (h >> 29) ^ unsigned(key.kind)) * 0xBF58476D1CE4E5B9ull;
+        return size_t(h ^ (h >> 32));
+    }
+};
+}
+
+/* ControlFlowGraph::shareSubexpressions
+* Find the subexpressions that occur more than once in a basic block, with
+* no write to a variable they read between the occurrences: the first one
+* that runs computes the value, the others take it from there (see
+* Expression::adoptShared). A write starts a new group of occurrences after
+* it.
+* Equal subtrees get the same value number, so a tape is numbered in one
+* pass; a write drops the numbers of the subtrees that read the variable,
+* which keeps the table at the subtrees that can still be shared. Elements and operations with an element or operation operand are
+* shared, the entries the memo rules of Expression give a memoOp; one whose
+* check compile dropped gets it back. The element a LET writes is not a
+* read and does not share.
+* Every occurrence gets the index of its group in TapeEntry::shared.
+* Return the number of groups.
+*/
+int ControlFlowGraph::shareSubexpressions(StatementTable& statements)
+{
+    int groups = 0;
+    sharedOccurrences = 0;
+    for(Statement& st : statements)
+        for(Expression* exp : st.expressions)
+            if(exp) for(TapeEntry& entry : exp->tape) entry.shared = -1;
+    struct Value
+    {
+        qint64 value;
+        bool inner;//an element or an operation
+    };
+    struct Occurrence
+    {
+        Expression* exp;
+        TapeEntry* entry;//the first occurrence of the group
+        int group;//-1 until a second occurrence is found
+        int block;//the block it is in, -1 if none or a write made it stale
+    };
+    std::unordered_map<ValueKey, int, ValueKeyHash> numbers;//only the keys no write made stale since
+    std::vector<ValueKey> keys;//by value number
+    std::vector<Occurrence> seen;//by value number
+    std::vector<std::vector<int>> readers;//by variable slot: the value numbers that read it
+    std::vector<Value> operands;//the values on the stack of the tape
+    std::vector<Expression*> unchecked;//expressions with shared entries that have no memoOp
+    auto share = [&](Expression* exp, TapeEntry& entry, int group){
+        entry.shared = group;
+        sharedOccurrences++;
+        if(entry.memoized) return;
+        entry.memoized = true;
+        if(unchecked.empty() || unchecked.back() != exp) unchecked.push_back(exp);
+    };
+    for(int b = 0; b < blocks.size(); b++){
+        const BasicBlock& block = blocks[b];
+        if(!block.reachable) continue;
+        for(int i = block.first; i <= block.last; i++){
+            Statement& st = statements[i];
+            for(int k = 0; k < Statement::maxExpressions; k++){
+                Expression* exp = st.expressions[k];
+                if(exp == nullptr) continue;
+                bool stored = st.type == StatementType::letStmt && k == 1;
+                operands.clear();
+                for(int e = 0; e < (int)exp->tape.size(); e++){
+                    TapeEntry& entry = exp->tape[e];
+                    ValueKey key = {};
+                    bool sharable = true;
+                    switch(entry.op){
+                    case memoOp:
+                        continue;
+                    case numberOp:
+                        operands.push_back({taggedValue(numberTag, entry.operand), false});
+                        continue;
+                    case variableOp:
+                        operands.push_back({taggedValue(variableTag, entry.operand), false});
+                        continue;
+                    case elementOp:
+                        key = {entry.operand, 0, operands.back().value};
+                        operands.pop_back();
+                        break;
+                    case operationOp:
+                        key = {-1 - entry.opt, operands[operands.size() - 2].value, operands.back().value};
+                        operands.resize(operands.size() - 2);
+                        break;
+                    case operationNumberOp:
+                    case operationVariableOp:
+                        key = {-1 - entry.opt, operands.back().value,
+                               taggedValue(entry.op == operationNumberOp ? numberTag : variableTag, entry.operand)};
+                        sharable = operands.back().inner;
+                        operands.pop_back();
+                        break;
+                    }
+                    auto numbered = numbers.try_emplace(key, (int)keys.size());
+                    int number = numbered.first->second;
+                    if(numbered.second){
+                        keys.push_back(key);
+                        seen.push_back(Occurrence{nullptr, nullptr, -1, -1});
+                        const int* slot = exp->dependencies.data() + entry.firstDependency;
+                        for(int d = 0; d < entry.dependencyCount; d++){
+                            if(slot[d] >= (int)readers.size()) readers.resize(slot[d] + 1);
+                            readers[slot[d]].push_back(number);
+                        }
+                    }
+                    operands.push_back({taggedValue(innerTag, number), true});
+                    if(!sharable || (stored && e + 1 == (int)exp->tape.size())) continue;
+                    Occurrence& first = seen[number];
+                    if(first.block != b){
+                        first = Occurrence{exp, &entry, -1, b};
+                        continue;
+                    }
+                    if(first.group < 0){
+                        first.group = groups++;
+                        share(first.exp, *first.entry, first.group);
+                    }
+                    share(exp, entry, first.group);
+                }
+            }
+            //the expressions of a statement are evaluated before it writes:
+            //the subtrees that read the variable get new numbers after it
+            int written = -1;
+            if(st.type == StatementType::letStmt && st.expressions[1] != nullptr) written = st.expressions[1]->tape.back().operand;
+            else if(st.type == StatementType::letStmt || st.type == StatementType::inputStmt || st.type == StatementType::dimStmt
+                    || st.type == StatementType::forStmt || st.type == StatementType::nextStmt) written = st.varSlot;
+            if(written < 0 || written >= (int)readers.size()) continue;
+            for(int number : readers[written]){
+                seen[number].block = -1;
+                auto key = numbers.find(keys[number]);
+                if(key != numbers.end() && key->second == number) numbers.erase(key);
+            }
+            readers[written].clear();
+        }
+    }
+    //the tapes change last: the occurrences point into them
+    std::sort(unchecked.begin(), unchecked.end());
+    unchecked.erase(std::unique(unchecked.begin(), unchecked.end()), unchecked.end());
+    for(Expression* exp : unchecked) exp->addMemoChecks();
+    subexpressionsShared = groups;
+    return groups;
+}
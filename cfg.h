@@ -0,0 +1,103 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <vector>
+
+class StatementTable;
+class Statement;
+class Expression;
+struct TapeEntry;
+enum ExpOperation : unsigned char;
+
+/*
+ * BasicBlock
+ * A run of consecutive lines that is only entered at its first line
+ * and only left after its last line.
+*/
+struct BasicBlock
+{
+    int first;//index of the first statement
+    int last;//index of the last statement
+    QVector<int> successors;//indices of the successor blocks
+    bool reachable;
+};
+
+/*
+ * RangeState
+ * What is known about the variables at a point of the program, see
+ * ControlFlowGraph::proveBounds: the range of the value of every variable
+ * slot and a lower bound of the size of every array (0: maybe no array).
+*/
+struct ValueRange
+{
+    long long lo;
+    long long hi;
+};
+
+struct RangeState
+{
+    bool reached = false;
+    QVector<ValueRange> values;
+    QVector<int> sizes;
+};
+
+/*
+ * ControlFlowGraph
+ * Built from the parsed statements of a program: GOTO, IF and GOSUB jump
+ * to their target line, FOR and NEXT to the line after the other end of
+ * their loop, every statement except GOTO, END and RETURN falls through to
+ * the next line. A GOSUB falls through when its subroutine returns, so
+ * RETURN itself has no successors.
+ * Program uses it to thread jump chains, to keep unreachable statements
+ * out of the execution plan, to drop the bounds checks of array accesses
+ * that are always in range and to share the subexpressions a basic block
+ * repeats.
+ * Statements are referred to by their index in the StatementTable.
+*/
+class ControlFlowGraph
+{
+public:
+    int matchLoops(StatementTable& statements);
+    void resetJumps(StatementTable& statements);
+    int threadJumps(StatementTable& statements);
+    void build(StatementTable& statements, int entryLine, const QVector<int>& activeCalls = QVector<int>());
+    int proveBounds(StatementTable& statements, int variableCount);
+    int shareSubexpressions(StatementTable& statements);
+    bool isReachable(int index) const;
+    QString report() const;
+    const QVector<BasicBlock>& getBlocks() const { return blocks; }
+
+private:
+    QVector<BasicBlock> blocks;
+    QVector<int> blockOf;//statement index -> block index
+    QVector<int> lineOf;//statement index -> line number
+    QVector<int> entryBlocks;//where a run starts or returns to from a call active at its start
+    int threaded = 0;
+    QVector<int> unreachableLines;
+    int elementAccesses = 0;
+    int boundsProven = 0;
+    int subexpressionsShared = 0;//groups of shareSubexpressions
+    int sharedOccurrences = 0;//entries in them
+    QVector<long long> thresholds;//bounds ranges are widened to
+    struct LoopRanges
+    {
+        int limitSlot;//state slot of the limit of the loop, the step follows it
+        int counter;//variable slot of the counter
+    };
+    QHash<int, LoopRanges> loopRanges;//by line of the FOR statement
+    mutable std::vector<ValueRange> ranges;//stack of rangeOf
+    std::vector<int> starts;//open memoOp entries of markElements
+    int finalTarget(StatementTable& statements, int line) const;
+    ValueRange rangeOf(const TapeEntry* first, const TapeEntry* last, const RangeState& state) const;
+    ValueRange rangeOf(const Expression* exp, const RangeState& state) const;
+    ValueRange combine(ExpOperation opt, ValueRange l, ValueRange r) const;
+    void transfer(const Statement& st, RangeState& state) const;
+    void refine(const Statement& st, bool taken, RangeState& state) const;
+    bool join(RangeState& into, const RangeState& from, bool widen) const;
+    int markElements(Expression* exp, const RangeState* state);
+};
+
+#endif // CFG_H
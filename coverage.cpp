@@ -0,0 +1,141 @@
+#include "coverage.h"
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+/* Coverage::enable
+* Record the following runs, forgetting the lines of the earlier ones.
+*/
+void Coverage::enable()
+{
+    lines.clear();
+    hash = 0;
+    enabled = true;
+}
+
+void Coverage::disable()
+{
+    enabled = false;
+    bits = std::vector<quint64>();
+    lines.clear();
+}
+
+/* Coverage::beginRun
+* Clear the bitmap for a plan of planSize statements.
+*/
+void Coverage::beginRun(int planSize)
+{
+    bits.assign((planSize + 63) / 64, 0);
+}
+
+/* Coverage::endRun
+* Add the statements the run executed, by the line of every plan index,
+* to the lines. programLines are all the lines of the program, in order:
+* if the program text changed since the last run, the earlier lines are
+* dropped.
+*/
+void Coverage::endRun(const QVector<int>& planLines, const QVector<int>& programLines, quint64 programHash)
+{
+    if(programHash != hash || lines.empty()){
+        lines.clear();
+        for(int line : programLines) lines.emplace_hint(lines.end(), line, false);
+        hash = programHash;
+    }
+    for(int i = 0; i < planLines.size(); i++)
+        if(bits[i >> 6] >> (i & 63) & 1) lines[planLines[i]] = true;
+}
+
+/* Coverage::merge
+* Add the lines of a JSON report (see toJson) of the program with hash
+* programHash. Return false and set error if the report is not one.
+*/
+bool Coverage::merge(const QString& report, quint64 programHash, QString& error)
+{
+    QStringList text = report.split('\n');
+    const QString& header = text[0];
+    int start = header.indexOf("\"program\": \"");
+    if(!header.startsWith('{') || start < 0){
+        error = "Not a coverage report";
+        return false;
+    }
+    start += 12;
+    bool ok;
+    quint64 reportHash = header.mid(start, header.indexOf('"', start) - start).toULongLong(&ok, 16);
+    if(!ok || reportHash != programHash){
+        error = "The coverage report is of a different program";
+        return false;
+    }
+    std::map<int, bool> merged;
+    for(int i = 1; i < text.size(); i++){
+        QString entry = text[i].trimmed();
+        if(!entry.startsWith('"')) continue;
+        int colon = entry.indexOf("\":");
+        bool lineOk, hitOk;
+        int line = entry.mid(1, colon - 1).toInt(&lineOk);
+        QString value = entry.mid(colon + 2).trimmed();
+        if(value.endsWith(',')) value.chop(1);
+        int hit = value.toInt(&hitOk);
+        if(colon < 0 || !lineOk || !hitOk){
+            error = "Invalid coverage line: " + entry;
+            return false;
+        }
+        merged[line] = hit != 0;
+    }
+    if(programHash != hash){
+        lines.clear();
+        hash = programHash;
+    }
+    for(const auto& [line, hit] : merged){
+        bool& ran = lines[line];
+        ran = ran || hit;
+    }
+    return true;
+}
+
+int Coverage::hitCount() const
+{
+    int count = 0;
+    for(const auto& entry : lines) count += entry.second;
+    return count;
+}
+
+/* Coverage::toJson
+* {"program": "<hash>", "lines": <n>, "hit": <n>, "coverage": {
+* "<line>": <1 if it ran, else 0>,
+* ...
+* }}
+* with one line of the program per text line.
+*/
+QString Coverage::toJson() const
+{
+    QString res = QString("{\"program\": \"%1\", \"lines\": %2, \"hit\": %3, \"coverage\": {\n")
+                      .arg(hash, 16, 16, QChar('0')).arg(lines.size()).arg(hitCount());
+    int left = lines.size();
+    for(const auto& [line, hit] : lines)
+        res += QString("\"%1\": %2%3\n").arg(line).arg(hit ? 1 : 0).arg(--left > 0 ? "," : "");
+    res += "}}\n";
+    return res;
+}
+
+/* Coverage::toLcov
+* One lcov record for the program, in the file sourceName.
+*/
+QString Coverage::toLcov(const QString& sourceName) const
+{
+    QString res = "TN:\nSF:" + (sourceName.isEmpty() ? QString("program") : sourceName) + "\n";
+    for(const auto& [line, hit] : lines) res += QString("DA:%1,%2\n").arg(line).arg(hit ? 1 : 0);
+    res += QString("LF:%1\nLH:%2\nend_of_record\n").arg(lines.size()).arg(hitCount());
+    return res;
+}
+
+/* Coverage::save
+* Write the report to filename: lcov if it ends in .info, JSON otherwise.
+*/
+bool Coverage::save(const QString& filename, const QString& sourceName) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate)) return false;
+    QTextStream out(&file);
+    out << (filename.endsWith(".info") ? toLcov(sourceName) : toJson());
+    return true;
+}
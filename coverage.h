@@ -0,0 +1,49 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <QString>
+#include <QVector>
+#include <map>
+#include <vector>
+
+/*
+ * Coverage
+ * The lines of a program that ran, over the runs since coverage was
+ * enabled. A run sets one bit per plan index in a bitmap allocated when
+ * it starts, which is all a statement costs; the bits are turned into
+ * lines when the run ends. Every line of the program is in the report, the
+ * lines that are not in the plan (unreachable, see ControlFlowGraph) as
+ * missed.
+ * The report is JSON, or lcov tracefile lines (DA:<line>,<0 or 1>) when
+ * the file name ends in .info. The JSON reports of other runs of the same
+ * program text, by other processes, can be merged in: they carry the hash
+ * of the text to check it.
+*/
+class Coverage
+{
+public:
+    void enable();
+    void disable();
+    bool isEnabled() const { return enabled; }
+    void beginRun(int planSize);
+    inline void hit(int index);//called before the statement at plan index is executed
+    void endRun(const QVector<int>& planLines, const QVector<int>& programLines, quint64 programHash);
+    bool merge(const QString& report, quint64 programHash, QString& error);
+    QString toJson() const;
+    QString toLcov(const QString& sourceName) const;
+    bool save(const QString& filename, const QString& sourceName) const;
+
+private:
+    bool enabled = false;
+    std::vector<quint64> bits;//one bit per plan index of the run
+    std::map<int, bool> lines;//every line of the program: ran or not
+    quint64 hash = 0;//of the program text the lines are from
+    int hitCount() const;
+};
+
+inline void Coverage::hit(int index)
+{
+    bits[index >> 6] |= quint64(1) << (index & 63);
+}
+
+#endif // COVERAGE_H
@@ -2,7 +2,40 @@
 #include "program.h"
 #include <QDebug>
 #include <QQueue>
+#include <algorithm>
+#include <climits>
+#include <new>
 #include "config.h"
+#include "metrics.h"
+#include "profiler.h"
+
+/*
+ * Parser scratch, shared by all expressions parsed on a thread:
+ * the tokens are only needed while building the tree, and the vectors keep
+ * their capacity, so parsing an expression does not allocate them again.
+*/
+static thread_local QVector<Token> tokens;
+static thread_local int pos;
+static thread_local std::vector<ExpressionNode*> parsedNodes;//nodes of the tree being built
+/* Compiler scratch, see Expression::compile.*/
+struct CompileFrame
+{
+    ExpressionNode* node;
+    int memo;//index of the memoOp entry of an expanded element or operation node, -1 before
+};
+struct CompiledValue
+{
+    int slot;//a variable, -1 otherwise
+    int firstDependency;//the dependencies of an element or operation
+    int dependencyCount;
+    int memo;//the memoOp entry of an operation, -1 if it has none
+};
+static thread_local std::vector<CompileFrame> frames;
+static thread_local std::vector<CompiledValue> compiledValues;//the stack of the tape while it is built
+static thread_local std::vector<unsigned char> operators;//profiler codes of the expanded nodes
+static thread_local std::vector<int> reads;
+static thread_local std::vector<int> moved;//new index of every entry when the tape is compacted
+static void consume(){pos++;}
 
 /*
  * ExpressionNode
@@ -10,104 +43,516 @@
 ExpressionNode::ExpressionNode(const Token&t)
 {
     type = t.type;
-    s = t.s;
     opt = t.opt;
     value = t.num;
+    slot = -1;
+    indexProven = false;
+    name = nullptr;
+    left = nullptr;
+    right = nullptr;
+}
+
+/* ExpressionNode::getText
+* The text of the node as shown in the syntax tree.
+*/
+QString ExpressionNode::getText() const
+{
+    if(type == ExpNodeType::number) return QString::number(value);
+    if(type == ExpNodeType::variable) return *name;
+    if(type == ExpNodeType::element) return *name + "()";
+    switch(opt){
+    case ExpOperation::add: return "+";
+    case ExpOperation::sub: return "-";
+    case ExpOperation::mul: return "*";
+    case ExpOperation::divide: return "/";
+    case ExpOperation::mod: return "MOD";
+    case ExpOperation::power: return "**";
+    }
+    return "";
+}
+
+/*
+ * NodePool
+ */
+NodePool::~NodePool()
+{
+    for(char* chunk : chunks) ::operator delete(chunk);
+}
+
+ExpressionNode* NodePool::allocate(const Token& t)
+{
+    ExpressionNode* place;
+    if(freeList != nullptr){
+        place = freeList;
+        freeList = freeList->left;
+    }
+    else{
+        if(usedInChunk == chunkSize){
+            chunks.push_back(static_cast<char*>(::operator new(chunkSize * sizeof(ExpressionNode))));
+            usedInChunk = 0;
+        }
+        place = reinterpret_cast<ExpressionNode*>(chunks.back()) + usedInChunk++;
+    }
+    inUse++;
+    return new (place) ExpressionNode(t);
+}
+
+void NodePool::release(ExpressionNode* node)
+{
+    node->left = freeList;
+    freeList = node;
+    inUse--;
+}
+
+/* NodePool::merge
+* Take over the chunks and free nodes of other, which is left empty.
+* The unused rest of other's last chunk goes to the free list.
+*/
+void NodePool::merge(NodePool& other)
+{
+    if(!other.chunks.empty()){
+        ExpressionNode* last = reinterpret_cast<ExpressionNode*>(other.chunks.back());
+        for(int i = other.usedInChunk; i < chunkSize; i++){
+            last[i].left = other.freeList;
+            other.freeList = &last[i];
+        }
+    }
+    while(other.freeList != nullptr){
+        ExpressionNode* node = other.freeList;
+        other.freeList = node->left;
+        node->left = freeList;
+        freeList = node;
+    }
+    //keep our last chunk last, its rest is still handed out in order
+    chunks.insert(chunks.begin(), other.chunks.begin(), other.chunks.end());
+    inUse += other.inUse;
+    other.chunks.clear();
+    other.usedInChunk = chunkSize;
+    other.inUse = 0;
 }
 
 /*
  * Expression
 */
-Expression::Expression(const QString& s_res,Program* program) : s(s_res),program(program) 
+/* Expression::Expression
+* Parse s_res to a tree and compile it to a tape. On a syntax error status
+* is set and the expression is left without a tree.
+*/
+Expression::Expression(const QString& s_res,Program* program,Status& status) : program(program)
 {
-    value = 0;
-    calculated = false;
-    pos = 0;
+    nodeCount = 0;
+    root = nullptr;
+    METRIC_INC(expressionParses);
     //Step1. Tokenize the expression.
-    Tokenizer tokenizer(s,program);
-    tokenizer.tokenize(tokens);
+    tokens.clear();
+    Tokenizer tokenizer(s_res,program);
+    tokenizer.tokenize(tokens, status);
+    if(!status.ok()) return;
     if(debugMode){
-        //qDebug() << "s: " << s;
+        //qDebug() << "s: " << s_res;
         //for(Token t : tokens){
         //    qDebug() <<"token: " << t.s << " " << t.type << " " << t.opt << " " << t.num;
         //}
     }
     pos=0;
     //Step2. Parse the expression to a tree.
-    root = parseExp();
+    parsedNodes.clear();
+    root = parseExp(status);
+    if(!status.ok()){
+        //give back the nodes of the partial tree
+        for(ExpressionNode* node : parsedNodes) program->nodes().release(node);
+        root = nullptr;
+        nodeCount = 0;
+        return;
+    }
+    int memoCount = 0;
+    for(ExpressionNode* node : parsedNodes)
+        memoCount += node->type == ExpNodeType::operation || node->type == ExpNodeType::element;
+    compile(memoCount);
     //Be careful.There is no need to calculate the tree here.
 }
 
-int Expression::evaluate() {
-    //TODO: Construct a tree and implement expression evaluation
-    if(calculated) return value;
+/* Expression::~Expression
+* Give the nodes of the tree back to the node pool: every node has one
+* entry of the tape that is not a memoOp, or is the right operand of one.
+*/
+Expression::~Expression()
+{
+    for(const TapeEntry& entry : tape){
+        if(entry.op == memoOp) continue;
+        if(entry.op == operationNumberOp || entry.op == operationVariableOp) program->nodes().release(entry.node->right);
+        program->nodes().release(entry.node);
+    }
+}
+
+/* Expression::newNode
+* Allocate a node for token t from the program's node pool.
+*/
+ExpressionNode* Expression::newNode(const Token& t)
+{
+    ExpressionNode* node = program->nodes().allocate(t);
+    if(t.type == ExpNodeType::variable || t.type == ExpNodeType::element)
+        node->slot = program->slotOf(t.s, &node->name);
+    parsedNodes.push_back(node);
+    nodeCount++;
+    METRIC_INC(parserAllocations);
+    return node;
+}
+
+/* Expression::compile
+* Build the postfix tape of the tree, walking it with an explicit stack:
+* an element or operation node is expanded to its memoOp entry and its
+* operands, and gets its own entry once they are on the tape.
+* Every element and operation entry gets the sorted set of variable slots
+* its subtree reads, stored in dependencies: the union of the sets of its
+* operands. An element entry also reads its array, whose slot changes
+* version on every write to one of its elements.
+* memoCount is the number of element and operation nodes.
+*/
+void Expression::compile(int memoCount)
+{
+    auto isInner = [](const ExpressionNode* node){
+        return node != nullptr && (node->type == ExpNodeType::operation || node->type == ExpNodeType::element);
+    };
+    tape.reserve(nodeCount + memoCount);
+    frames.clear();
+    compiledValues.clear();
+    operators.clear();
+    frames.push_back({root, -1});
+    int dropped = 0;
+    while(!frames.empty()){
+        CompileFrame frame = frames.back();
+        ExpressionNode* node = frame.node;
+        bool inner = isInner(node);
+        if(inner && frame.memo < 0){
+            bool memoized = node->type == ExpNodeType::element || isInner(node->left) || isInner(node->right);
+            frames.back().memo = memoized ? (int)tape.size() : INT_MAX;
+            if(memoized){
+                TapeEntry memo = {};
+                memo.op = memoOp;
+                tape.push_back(memo);
+            }
+            operators.push_back(node->type == ExpNodeType::element ? elementOperator : profileOperatorOf(node->opt));
+            //the left operand is compiled first, a right leaf goes into the operation
+            if(isInner(node->right)) frames.push_back({node->right, -1});
+            if(node->left != nullptr) frames.push_back({node->left, -1});
+            continue;
+        }
+        frames.pop_back();
+        TapeEntry entry = {};
+        entry.opt = node->opt;
+        entry.node = node;
+        if(!inner){
+            entry.op = node->type == ExpNodeType::number ? numberOp : variableOp;
+            entry.operand = node->type == ExpNodeType::number ? (int)node->value : node->slot;
+            tape.push_back(entry);
+            compiledValues.push_back({entry.op == variableOp ? node->slot : -1, 0, 0, -1});
+            stackDepth = std::max(stackDepth, (int)compiledValues.size());
+            continue;
+        }
+        operators.pop_back();
+        int operands = 2;
+        reads.clear();
+        if(node->type == ExpNodeType::element){
+            entry.op = elementOp;
+            entry.operand = node->slot;
+            operands = 1;
+            reads.push_back(node->slot);
+        }
+        else if(isInner(node->right)) entry.op = operationOp;
+        else{
+            const ExpressionNode* right = node->right;
+            entry.op = right->type == ExpNodeType::number ? operationNumberOp : operationVariableOp;
+            entry.operand = right->type == ExpNodeType::number ? (int)right->value : right->slot;
+            operands = 1;
+            if(entry.op == operationVariableOp) reads.push_back(right->slot);
+        }
+        entry.outerOperator = operators.empty() ? 0 : operators.back();
+        entry.memoized = frame.memo != INT_MAX;
+        for(auto value = compiledValues.end() - operands; value != compiledValues.end(); ++value){
+            if(value->slot >= 0) reads.push_back(value->slot);
+            else reads.insert(reads.end(), dependencies.begin() + value->firstDependency,
+                              dependencies.begin() + value->firstDependency + value->dependencyCount);
+        }
+        std::sort(reads.begin(), reads.end());
+        reads.erase(std::unique(reads.begin(), reads.end()), reads.end());
+        entry.firstDependency = dependencies.size();
+        entry.dependencyCount = reads.size();
+        dependencies.insert(dependencies.end(), reads.begin(), reads.end());
+        //an operation operand that reads the same variables is only valid
+        //when this entry is: its check is dropped
+        for(auto value = compiledValues.end() - operands; value != compiledValues.end(); ++value){
+            if(!entry.memoized || value->memo < 0 || value->dependencyCount != entry.dependencyCount) continue;
+            TapeEntry& memo = tape[value->memo];
+            tape[memo.operand].memoized = false;
+            memo.operand = -1;
+            dropped++;
+        }
+        compiledValues.resize(compiledValues.size() - operands);
+        compiledValues.push_back({-1, entry.firstDependency, entry.dependencyCount,
+                                  entry.memoized && entry.op != elementOp ? frame.memo : -1});
+        if(entry.memoized) tape[frame.memo].operand = tape.size();
+        tape.push_back(entry);
+    }
+    if(dropped == 0) return;
+    //compact the tape, the memoOp entries point to entries after them
+    moved.resize(tape.size());
+    int kept = 0;
+    for(int i = 0; i < (int)tape.size(); i++){
+        moved[i] = kept;
+        if(tape[i].op != memoOp || tape[i].operand >= 0) kept++;
+    }
+    kept = 0;
+    for(int i = 0; i < (int)tape.size(); i++){
+        if(tape[i].op == memoOp && tape[i].operand < 0) continue;
+        tape[kept] = tape[i];
+        if(tape[kept].op == memoOp) tape[kept].operand = moved[tape[kept].operand];
+        kept++;
+    }
+    tape.resize(kept);
+}
+
+/* Expression::addMemoChecks
+* Give every memoized entry that has no memoOp one, at the start of its
+* subtree: the memoOp of its first operand, or that operand itself, is
+* where it starts. Entries are marked memoized again after compile
+* dropped their check when they are shared.
+*/
+void Expression::addMemoChecks()
+{
+    int n = tape.size();
+    std::vector<int> memoAt(n, -1);//index of the memoOp of an entry
+    for(int i = 0; i < n; i++) if(tape[i].op == memoOp) memoAt[tape[i].operand] = i;
+    //Step1. Find the start of every subtree on the stack of the tape.
+    std::vector<int> starts;
+    std::vector<std::pair<int, int>> inserts;//start, entry: the memoOps to add
+    for(int i = 0; i < n; i++){
+        const TapeEntry& entry = tape[i];
+        int start = i;
+        switch(entry.op){
+        case memoOp:
+            continue;
+        case numberOp:
+        case variableOp:
+            break;
+        case operationOp:
+            starts.pop_back();
+            start = starts.back();
+            starts.pop_back();
+            break;
+        case elementOp:
+        case operationNumberOp:
+        case operationVariableOp:
+            start = starts.back();
+            starts.pop_back();
+            break;
+        }
+        if(memoAt[i] >= 0) start = memoAt[i];
+        else if(entry.memoized) inserts.push_back({start, -i});//the outer subtree's check first
+        starts.push_back(start);
+    }
+    if(inserts.empty()) return;
+    std::sort(inserts.begin(), inserts.end());
+    //Step2. Copy the tape with the new memoOps and point the memoOps to the new indices.
+    std::vector<TapeEntry> checked;
+    checked.reserve(n + inserts.size());
+    moved.resize(n);
+    size_t next = 0;
+    for(int i = 0; i < n; i++){
+        for(; next < inserts.size() && inserts[next].first == i; next++){
+            TapeEntry memo = {};
+            memo.op = memoOp;
+            memo.operand = -inserts[next].second;
+            checked.push_back(memo);
+        }
+        moved[i] = checked.size();
+        checked.push_back(tape[i]);
+    }
+    for(TapeEntry& entry : checked) if(entry.op == memoOp) entry.operand = moved[entry.operand];
+    tape.swap(checked);
+}
 
-    //Step3. Evaluate the tree
-    value = calculateTree(root);
-    calculated = true;
-    return value;
+/* Expression::isMemoValid
+* True if the memoized value of an element or operation entry is still its
+* result: none of the variables it reads was written since it was computed.
+*/
+bool Expression::isMemoValid(const TapeEntry& entry) const
+{
+    if(entry.validAt == 0) return false;
+    const int* slot = dependencies.data() + entry.firstDependency;
+    for(int i = 0; i < entry.dependencyCount; i++)
+        if(program->variables[slot[i]].version > entry.validAt) return false;
+    return true;
+}
+
+/* Expression::adoptShared
+* Called when the memo of a shared entry is not valid: take the value the
+* occurrence of its subexpression that ran last computed, which reads the
+* same variables, and return true if it is valid. Otherwise the entry is
+* about to compute it and becomes that occurrence.
+*/
+bool Expression::adoptShared(TapeEntry& entry)
+{
+    const TapeEntry*& source = program->sharedSources[entry.shared];
+    if(source != nullptr && source != &entry && source->validAt > entry.validAt){
+        entry.value = source->value;
+        entry.validAt = source->validAt;
+        if(isMemoValid(entry)){
+            METRIC_INC(sharedHits);
+            return true;
+        }
+    }
+    source = &entry;
+    return false;
+}
+
+int Expression::evaluate(Status& status) {
+    //The expression is kept by its statement and evaluated on every execution.
+    //Step3. Run the tape, reusing the subtrees whose variables did not change.
+    //A single number or variable and an unchanged expression are answered
+    //without the loop.
+    const TapeEntry& first = tape.front();
+    if(tape.size() == 1){
+        METRIC_INC(nodesEvaluated);
+        int value = first.operand;
+        if(first.op == variableOp && !readVariable(first, value, status)) return 0;
+        return value;
+    }
+    if(first.op == memoOp && isMemoValid(tape.back())){
+        METRIC_INC(nodesEvaluated);
+        METRIC_INC(memoHits);
+        return tape.back().value;
+    }
+    return run(0, tape.size(), status);
+}
+
+/* Expression::isElement
+* True if the expression is a single array element, a(i): the target of
+* LET a(i) = ...
+*/
+bool Expression::isElement() const
+{
+    return root->type == ExpNodeType::element;
+}
+
+/* Expression::store
+* Assign value to the array element the expression names (see isElement).
+* The tape is the memoOp of the element, its index and the element entry:
+* only the index is run.
+*/
+void Expression::store(int value, Status& status)
+{
+    int index = run(1, tape.size() - 1, status);
+    if(!status.ok()) return;
+    int* target = element(root, index, status);
+    if(target == nullptr) return;
+    *target = value;
+    program->variables[root->slot].version = ++program->writeClock;
+    METRIC_INC(variableWrites);
+}
+
+/* Expression::element
+* The element of the array of node at index.
+* The index is checked against the size of the array unless the check was
+* proven redundant for every execution of the plan.
+* Return nullptr and set status if there is no such element.
+*/
+int* Expression::element(const ExpressionNode* node, int index, Status& status)
+{
+    Program::Variable& var = program->variables[node->slot];
+    if (!var.validName) {
+        status.fail(ErrorCode::invalidVariableName, *node->name);
+        return nullptr;
+    }
+    if(!var.isArray){
+        status.fail(ErrorCode::arrayNotDimensioned, *node->name);
+        return nullptr;
+    }
+    if(!node->indexProven){
+        METRIC_INC(boundsChecks);
+        if((unsigned)index >= var.elements.size()){
+            status.fail(ErrorCode::indexOutOfRange, *node->name, index);
+            return nullptr;
+        }
+    }
+    return &var.elements[index];
 }
 
 /*
  * Parse the expression to a tree,Using recursive descent parsing.
  * Contains: parseExp(), parseTerm(), parsePower(), parseFactor()
+ * After a syntax error in status the parse stops; the partial tree is
+ * released by the constructor.
 */
 
-ExpressionNode* Expression::parseExp(){
-    ExpressionNode* node = parseTerm();
-    while(pos < tokens.size() && (tokens[pos].s=="+" || tokens[pos].s=="-")){
-        ExpressionNode* node2 = new ExpressionNode(tokens[pos]);
+ExpressionNode* Expression::parseExp(Status& status){
+    ExpressionNode* node = parseTerm(status);
+    while(status.ok() && pos < tokens.size() && (tokens[pos].s=="+" || tokens[pos].s=="-")){
+        ExpressionNode* node2 = newNode(tokens[pos]);
         consume();
-        node2->children.push_back(node);
-        node2->children.push_back(parseTerm());
+        node2->left = node;
+        node2->right = parseTerm(status);
         node = node2;
     }
     return node;
 }
 
-ExpressionNode* Expression::parseTerm(){
-    ExpressionNode* node = parsePower();
-    while(pos < tokens.size() && (tokens[pos].s=="*" || tokens[pos].s=="/" || tokens[pos].s=="MOD")){
-        ExpressionNode* node2 = new ExpressionNode(tokens[pos]);
+ExpressionNode* Expression::parseTerm(Status& status){
+    ExpressionNode* node = parsePower(status);
+    while(status.ok() && pos < tokens.size() && (tokens[pos].s=="*" || tokens[pos].s=="/" || tokens[pos].s=="MOD")){
+        ExpressionNode* node2 = newNode(tokens[pos]);
         consume();
-        node2->children.push_back(node);
-        node2->children.push_back(parsePower());
+        node2->left = node;
+        node2->right = parsePower(status);
         node = node2;
     }
     return node;
 }
 
-ExpressionNode* Expression::parsePower(){
-    ExpressionNode* node = parseFactor();
-    if(pos < tokens.size() && tokens[pos].s=="**"){
-        ExpressionNode* node2 = new ExpressionNode(tokens[pos]);
+ExpressionNode* Expression::parsePower(Status& status){
+    ExpressionNode* node = parseFactor(status);
+    if(status.ok() && pos < tokens.size() && tokens[pos].s=="**"){
+        ExpressionNode* node2 = newNode(tokens[pos]);
         consume();
-        node2->children.push_back(node);
-        node2->children.push_back(parsePower());
+        node2->left = node;
+        node2->right = parsePower(status);
         return node2;
     }
     return node;
 }
 
-ExpressionNode* Expression::parseFactor(){
-    if(pos==tokens.size()) throw std::invalid_argument("Invalid expression");
+ExpressionNode* Expression::parseFactor(Status& status){
+    if(pos==tokens.size()){
+        status.fail(ErrorCode::invalidExpression);
+        return nullptr;
+    }
     if(tokens[pos].type==ExpNodeType::variable){
-        ExpressionNode* node = new ExpressionNode(tokens[pos]);
+        ExpressionNode* node = newNode(tokens[pos]);
         consume();
         return node;
     }
     else if(tokens[pos].type==ExpNodeType::number){
-        ExpressionNode* node = new ExpressionNode(tokens[pos]);
+        ExpressionNode* node = newNode(tokens[pos]);
+        consume();
+        return node;
+    }
+    else if(tokens[pos].type==ExpNodeType::element){
+        ExpressionNode* node = newNode(tokens[pos]);
+        consume();
+        consume();//Consume the "("
+        node->left = parseExp(status);
+        if(status.ok() && (pos==tokens.size() || tokens[pos].s!=")")) status.fail(ErrorCode::bracketExpected);
         consume();
         return node;
     }
     else if(tokens[pos].s=="("){
         consume();
-        ExpressionNode* node = parseExp();
+        ExpressionNode* node = parseExp(status);
         consume();//Consume the ")"
         return node;
     }
-    else throw std::invalid_argument("Invalid expression");
+    status.fail(ErrorCode::invalidExpression);
+    return nullptr;
 }
 
 int Expression::myMod(int a,int b){
@@ -118,39 +563,136 @@ int Expression::myMod(int a,int b){
     return result;
 }
 
-/*
- * Calculate the tree
+/* Expression::readVariable
+* The value of the variable of a variableOp or operationVariableOp entry
+* in value. Return false and set status if it has none.
 */
-int Expression::calculateTree(ExpressionNode* node){
-    //qDebug() << "Evaluate: " << node->s ;
-    if(node->type==ExpNodeType::number) return node->value;
-    else if(node->type==ExpNodeType::variable){
-        if (!program->isValidVariableName(node->s)) {
-            throw std::invalid_argument("Invalid variable name: " + node->s.toStdString());
-        }
-        if(program->variables.find(node->s)==program->variables.end()) 
-            throw std::invalid_argument("Variable not found: " + node->s.toStdString());
-        else return program->variables[node->s];
+inline bool Expression::readVariable(const TapeEntry& entry, int& value, Status& status) const
+{
+    const Program::Variable& var = program->variables[entry.operand];
+    if(!var.validName || !var.defined){
+        const QString& name = *(entry.op == variableOp ? entry.node : entry.node->right)->name;
+        if (!var.validName) status.fail(ErrorCode::invalidVariableName, name);
+        else status.fail(var.isArray ? ErrorCode::arrayAsVariable : ErrorCode::variableNotFound, name);
+        return false;
     }
-    else if(node->type==ExpNodeType::operation){
-        int left = calculateTree(node->children[0]);
-        int right = calculateTree(node->children[1]);
-        if(node->opt==ExpOperation::add) node->value = left+right;
-        else if(node->opt==ExpOperation::sub) node->value = left-right;
-        else if(node->opt==ExpOperation::mul) node->value = left*right;
-        else if(node->opt==ExpOperation::divide){   
-            if(right==0) throw std::invalid_argument("Division by zero");
-            node->value = left/right;
+    METRIC_INC(variableReads);
+    value = var.value;
+    return true;
+}
+
+/* Expression::run
+* Run the entries first ... last - 1 of the tape and return the value they
+* leave on the stack. The stack is on the C++ stack unless the tape needs
+* more than localStackSize values, then it is one buffer per thread.
+* On an error status is set and the result is 0; every caller checks
+* status before using a result. The profiler sees the operator whose
+* operands or itself are being evaluated, as a nested evaluation would
+* publish it.
+*/
+int Expression::run(int first, int last, Status& status)
+{
+    int localStack[localStackSize];
+    int* stack = localStack;
+    if(stackDepth > localStackSize){
+        //the evaluation never runs another tape on the same thread
+        static thread_local std::vector<int> deepStack;
+        if((int)deepStack.size() < stackDepth) deepStack.resize(stackDepth);
+        stack = deepStack.data();
+    }
+    int top = 0;//values on the stack
+    const int savedOperator = PROFILER_ENABLED ? profiledOperator.load(std::memory_order_relaxed) : 0;
+    TapeEntry* entries = tape.data();
+    for(int pc = first; pc < last; pc++){
+        TapeEntry& entry = entries[pc];
+        switch(entry.op){
+        case numberOp:
+            METRIC_INC(nodesEvaluated);
+            stack[top++] = entry.operand;
+            break;
+        case variableOp:
+            METRIC_INC(nodesEvaluated);
+            if(!readVariable(entry, stack[top], status)) goto failed;
+            top++;
+            break;
+        case memoOp:{
+            TapeEntry& target = entries[entry.operand];
+            if(isMemoValid(target) || (target.shared >= 0 && adoptShared(target))){
+                METRIC_INC(nodesEvaluated);
+                METRIC_INC(memoHits);
+                stack[top++] = target.value;
+                pc = entry.operand;
+                break;
+            }
+            if(PROFILER_ENABLED)
+                profiledOperator.store(target.op == elementOp ? elementOperator : profileOperatorOf(target.opt),
+                                       std::memory_order_relaxed);
+            break;
+        }
+        case elementOp:{
+            METRIC_INC(nodesEvaluated);
+            const int* element = this->element(entry.node, stack[top - 1], status);
+            if(element == nullptr) goto failed;
+            entry.value = *element;
+            METRIC_INC(variableReads);
+            entry.validAt = program->writeClock;
+            stack[top - 1] = entry.value;
+            if(PROFILER_ENABLED) profiledOperator.store(entry.outerOperator, std::memory_order_relaxed);
+            break;
+        }
+        case operationOp:
+        case operationNumberOp:
+        case operationVariableOp:{
+            METRIC_INC(nodesEvaluated);
+            if(PROFILER_ENABLED && !entry.memoized)
+                profiledOperator.store(profileOperatorOf(entry.opt), std::memory_order_relaxed);
+            int right;
+            if(entry.op == operationOp) right = stack[--top];
+            else if(entry.op == operationNumberOp){
+                METRIC_INC(nodesEvaluated);
+                right = entry.operand;
+            }
+            else{
+                METRIC_INC(nodesEvaluated);
+                if(!readVariable(entry, right, status)) goto failed;
+            }
+            int left = stack[top - 1];
+            int value = 0;
+            if(entry.opt==ExpOperation::add) value = left+right;
+            else if(entry.opt==ExpOperation::sub) value = left-right;
+            else if(entry.opt==ExpOperation::mul) value = left*right;
+            else if(entry.opt==ExpOperation::divide){
+                if(right==0){
+                    status.fail(ErrorCode::divisionByZero);
+                    goto failed;
+                }
+                value = left/right;
+            }
+            else if(entry.opt==ExpOperation::mod){
+                if(right==0){
+                    status.fail(ErrorCode::divisionByZero);
+                    goto failed;
+                }
+                value = myMod(left,right);
+            }
+            else if(entry.opt==ExpOperation::power){
+                long long power = pow(left,right);
+                value = power;
+            }
+            //not reached when the evaluation fails, so errors are never memoized
+            entry.value = value;
+            entry.validAt = program->writeClock;
+            stack[top - 1] = value;
+            if(PROFILER_ENABLED) profiledOperator.store(entry.outerOperator, std::memory_order_relaxed);
+            break;
         }
-        else if(node->opt==ExpOperation::mod){
-            if(right==0) throw std::invalid_argument("Division by zero");
-            //TODO:implement a mod function to fit the requirement of the project.
-            node->value = myMod(left,right);
         }
-        else if(node->opt==ExpOperation::power) node->value = pow(left,right);
-        return node->value;
     }
-    else throw std::invalid_argument("Invalid expression");
+    if(PROFILER_ENABLED) profiledOperator.store(savedOperator, std::memory_order_relaxed);
+    return stack[top - 1];
+failed:
+    if(PROFILER_ENABLED) profiledOperator.store(savedOperator, std::memory_order_relaxed);
+    return 0;
 }
 
 /*
@@ -167,13 +709,14 @@ QString Expression::getExpressionTree(){
     while(!q.isEmpty()){
         ExpressionNode* node = q.dequeue();
         int offset = offset_q.dequeue();
-        for(ExpressionNode* child : node->children){
+        for(ExpressionNode* child : {node->left, node->right}){
+            if(child == nullptr) continue;
             q.enqueue(child);
             offset_q.enqueue(offset+1);
         }
         QString str = "";
         for(int i=0;i<offset+1;i++) str += "    ";
-        str += node->s;
+        str += node->getText();
         result += str + "\n";
     }
     
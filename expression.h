@@ -3,6 +3,7 @@
 
 #include <QString>
 #include <QVector>
+#include <vector>
 #include "tokenizer.h"
 
 class Program;
@@ -12,45 +13,136 @@ class Tokenizer;
 class ExpressionNode
 {
 private:
-    QString s;//the string of the node
-    QVector<ExpressionNode*> children;
+    const QString* name;//name of a variable node, owned by the program's name table
+    ExpressionNode* left;//operands of an operation node
+    ExpressionNode* right;
+    long long value;//number
+    int slot;//variable slot of a variable or element node
     ExpNodeType type;
-    long long value;
     ExpOperation opt;
+    bool indexProven;//element node: the index is always in range (see ControlFlowGraph::proveBounds)
 
 
 public:
-    ExpressionNode(const QString& s);
     ExpressionNode(const Token& t);
-    //~ExpressionNode();
+    QString getText() const;
     friend class Expression;
+    friend class NodePool;
+    friend class ControlFlowGraph;
+    friend class Lockstep;
 };
 
+/*
+ * NodePool
+ * Allocates the expression nodes of a program from large chunks instead of
+ * one heap block per node. Released nodes go to a free list and are reused.
+*/
+class NodePool
+{
+public:
+    NodePool() = default;
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+    ~NodePool();
+    ExpressionNode* allocate(const Token& t);
+    void release(ExpressionNode* node);
+    void merge(NodePool& other);
+    size_t getNodesInUse() const { return inUse; }
+    size_t getBytesReserved() const { return chunks.size() * chunkSize * sizeof(ExpressionNode); }
+
+private:
+    static const int chunkSize = 1024;//nodes per chunk
+    std::vector<char*> chunks;
+    int usedInChunk = chunkSize;//nodes handed out from the last chunk
+    ExpressionNode* freeList = nullptr;//linked through ExpressionNode::left
+    size_t inUse = 0;
+};
+
+enum TapeOp : unsigned char{
+    numberOp,//push operand
+    variableOp,//push the variable in slot operand
+    elementOp,//replace the index on top by the element of the array in slot operand
+    operationOp,//replace the two values on top by their result under opt
+    operationNumberOp,//replace the value on top by its result under opt with the number operand
+    operationVariableOp,//replace the value on top by its result under opt with the variable in slot operand
+    memoOp,//start of the subtree entry operand computes: skipped while its value is valid
+};
+
+/*
+ * TapeEntry
+ * One instruction of the postfix tape of an expression. A right operand
+ * that is a number or a variable is part of its operation entry.
+ * Element and operation entries memoize their result: value is valid
+ * while no variable the subtree reads was written after validAt (0: not
+ * evaluated yet). The memoOp entry before the subtree checks it. Every
+ * element has one; an operation has one if an operand is an element or
+ * an operation (two variables are computed as fast as they are checked)
+ * and the operation around it does not read the same variables (then
+ * both are valid or neither is). An entry that is shared with the equal
+ * subtrees of its basic block always has a memoOp, which also accepts the
+ * value the last of them computed (see Expression::adoptShared).
+*/
+struct TapeEntry
+{
+    TapeOp op;
+    ExpOperation opt;
+    unsigned char outerOperator;//profiler code of the enclosing operation, see profileOperatorOf
+    bool memoized;//an element or operation entry has a memoOp
+    int operand;
+    int value;
+    int firstDependency;//slots read by the subtree, in Expression::dependencies
+    int dependencyCount;
+    int shared = -1;//index in Program::sharedSources, -1: not shared
+    quint64 validAt;
+    ExpressionNode* node;//the node of the entry, nullptr for memoOp
+};
+
+/*
+ * Expression
+ * An expression is parsed to a tree of ExpressionNode, which the syntax
+ * tree display shows, and compiled to a postfix tape, which is what is
+ * evaluated (and analysed, see ControlFlowGraph and Lockstep): one loop
+ * over contiguous entries and a value stack, without recursion, so the
+ * depth of an expression is only bounded by memory.
+*/
 class Expression
 {
 public:
-    Expression(const QString& s_res,Program* program);
-    int evaluate();
-    int value;bool calculated;
+    Expression(const QString& s_res,Program* program,Status& status);
+    ~Expression();
+    int evaluate(Status& status);
+    bool isElement() const;
+    void store(int value, Status& status);
+    int getNodeCount() const { return nodeCount; }
+    size_t getTapeBytes() const { return tape.capacity() * sizeof(TapeEntry); }
 private:
-    QString s;
-    QVector<Token> tokens;
+    static const int localStackSize = 32;//values evaluated without a heap stack
     Program* program;
     ExpressionNode* root;
-    int pos;
-    void tokenize();
-    int myMod(int a,int b);
+    int nodeCount;//number of nodes in the tree
+    std::vector<TapeEntry> tape;
+    int stackDepth = 0;//values on the stack at most while running the tape
+    std::vector<int> dependencies;//sorted variable slots of every element and operation entry
+    static int myMod(int a,int b);
+    ExpressionNode* newNode(const Token& t);
+    void compile(int memoCount);
+    void addMemoChecks();
+    bool isMemoValid(const TapeEntry& entry) const;
+    bool adoptShared(TapeEntry& entry);
+    bool readVariable(const TapeEntry& entry, int& value, Status& status) const;
+    int run(int first, int last, Status& status);
+    int* element(const ExpressionNode* node, int index, Status& status);
 
 private:
-    void consume(){pos++;}
-    ExpressionNode* parseExp();
-    ExpressionNode* parseTerm();
-    ExpressionNode* parsePower();
-    ExpressionNode* parseFactor();
+    ExpressionNode* parseExp(Status& status);
+    ExpressionNode* parseTerm(Status& status);
+    ExpressionNode* parsePower(Status& status);
+    ExpressionNode* parseFactor(Status& status);
 
 public:
     QString getExpressionTree();
-    int calculateTree(ExpressionNode* node);
+    friend class ControlFlowGraph;
+    friend class Lockstep;
 };
 
-#endif
\ No newline at end of file
+#endif
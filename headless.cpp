@@ -0,0 +1,294 @@
+#include "headless.h"
+#include "program.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "scanner.h"
+#include "lexicon.h"
+#include "lockstep.h"
+#include "loader.h"
+#include <QFile>
+#include <QTextStream>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/* heapInUse
+* Bytes currently allocated from the heap, -1 if unknown on this platform.
+*/
+static qint64 heapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+/* loadProgramText
+* Add the "<line> <statement>" lines of text to program.
+* Return false if a line can not be parsed.
+*/
+bool loadProgramText(Program& program, const QString& text)
+{
+    for (int begin = 0, end = 0; begin < text.size(); begin = end + 1) {
+        end = Scanner::findLineBreak(text.constData(), begin, text.size());
+        QString trimmed = text.mid(begin, end - begin).trimmed();
+        if(trimmed.isEmpty()) continue;
+        int line;
+        QString statement;
+        if(!splitProgramLine(trimmed, line, statement) || !program.updateStatement(line, statement)){
+            program.reportError("Load Error", "Invalid program line: " + trimmed);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* loadProgramFile
+* Read "<line> <statement>" lines from filename into program.
+* Return false if the file can not be opened or a line can not be parsed.
+*/
+static bool loadProgramFile(Program& program, const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        program.reportError("Load Error", "Failed to open file: " + filename);
+        return false;
+    }
+    QTextStream in(&file);
+    return loadProgramText(program, in.readAll());
+}
+
+/* parseLimitOption
+* If args[i] is one of the --max-* options, store its value in limits,
+* advance i past it and return true.
+*/
+bool parseLimitOption(const QStringList& args, int& i, ExecutionLimits& limits)
+{
+    if(i + 1 >= args.size()) return false;
+    if(args[i] == "--max-steps") limits.maxSteps = args[++i].toLongLong();
+    else if(args[i] == "--max-time-ms") limits.maxWallMs = args[++i].toLongLong();
+    else if(args[i] == "--max-output-lines") limits.maxOutputLines = args[++i].toLongLong();
+    else if(args[i] == "--max-expr-memory") limits.maxExpressionBytes = args[++i].toLongLong();
+    else if(args[i] == "--max-call-depth") limits.maxCallDepth = args[++i].toInt();
+    else return false;
+    return true;
+}
+
+/* runImmediateFile
+* Execute the lines of filename as immediate commands (PRINT, LET, INPUT
+* and DIM), with the variables the run left.
+* Return false if the file can not be opened or a command fails.
+*/
+static bool runImmediateFile(Program& program, const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        program.reportError("Load Error", "Failed to open file: " + filename);
+        return false;
+    }
+    QTextStream in(&file);
+    QString text = in.readAll();
+    for (int begin = 0, end = 0; begin < text.size(); begin = end + 1) {
+        end = Scanner::findLineBreak(text.constData(), begin, text.size());
+        QString command = text.mid(begin, end - begin).trimmed();
+        if(command.isEmpty()) continue;
+        switch(keywordOf(command.left(command.indexOf(' ')))){
+        case printKw:
+        case letKw:
+        case inputKw:
+        case dimKw:
+            if(!program.executeStatement(command)) return false;
+            break;
+        default:
+            program.reportError("Error", "Invalid immediate command: " + command);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* readInputSets
+* Read the input sets of a lockstep run from filename: the INPUT lines of
+* one run after the other, separated by "---" lines.
+*/
+static bool readInputSets(const QString& filename, std::vector<QStringList>& sets)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+    QTextStream in(&file);
+    sets.assign(1, QStringList());
+    while(!in.atEnd()){
+        QString line = in.readLine();
+        if(line.trimmed() == "---") sets.emplace_back();
+        else sets.back().append(line);
+    }
+    return true;
+}
+
+/* runLockstep
+* Run program once per input set of filename (see readInputSets) with
+* Program::executeLockstep. The output and the errors of every run follow
+* a "--- <n>" line, n counting from 1, on stdout and stderr.
+*/
+static bool runLockstep(Program& program, const QString& filename, QTextStream& out, QTextStream& err)
+{
+    std::vector<QStringList> sets;
+    if(!readInputSets(filename, sets)){
+        err << "Failed to open input file: " << filename << "\n";
+        return false;
+    }
+    std::vector<LockstepResult> results;
+    bool ok = program.executeLockstep(sets, results);
+    for(size_t i = 0; i < results.size(); i++){
+        out << "--- " << (qint64)(i + 1) << "\n" << results[i].output;
+        if(!results[i].errors.isEmpty()) err << "--- " << (qint64)(i + 1) << "\n" << results[i].errors;
+    }
+    return ok;
+}
+
+/* writeTextFile
+* Write s to filename, replacing its content.
+*/
+static bool writeTextFile(const QString& filename, const QString& s)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate)) return false;
+    QTextStream out(&file);
+    out << s;
+    return true;
+}
+
+int runHeadless(const QStringList& args)
+{
+    QString programFile, inputFile, statsFile, cfgFile, snapshotFile, restoreFile;
+    int snapshotLine = 0;
+    QString traceFile;
+    int traceSample = 1, traceEvents = Tracer::defaultCapacity;
+    QString profileFile, foldedFile, immediateFile, lockstepFile;
+    QString coverageFile;
+    QStringList coverageMerges;
+    int profileHz = 1000;
+    bool memReport = false;
+    ExecutionLimits limits;
+    for(int i = 0; i < args.size(); i++){
+        if(args[i] == "--headless" && i + 1 < args.size()) programFile = args[++i];
+        else if(args[i] == "--input" && i + 1 < args.size()) inputFile = args[++i];
+        else if(args[i] == "--stats-json" && i + 1 < args.size()) statsFile = args[++i];
+        else if(args[i] == "--cfg" && i + 1 < args.size()) cfgFile = args[++i];
+        else if(parseLimitOption(args, i, limits)) continue;
+        else if(args[i] == "--snapshot" && i + 1 < args.size()) snapshotFile = args[++i];
+        else if(args[i] == "--snapshot-at" && i + 1 < args.size()) snapshotLine = args[++i].toInt();
+        else if(args[i] == "--restore" && i + 1 < args.size()) restoreFile = args[++i];
+        else if(args[i] == "--trace" && i + 1 < args.size()) traceFile = args[++i];
+        else if(args[i] == "--trace-sample" && i + 1 < args.size()) traceSample = args[++i].toInt();
+        else if(args[i] == "--trace-events" && i + 1 < args.size()) traceEvents = args[++i].toInt();
+        else if(args[i] == "--profile" && i + 1 < args.size()) profileFile = args[++i];
+        else if(args[i] == "--profile-folded" && i + 1 < args.size()) foldedFile = args[++i];
+        else if(args[i] == "--profile-hz" && i + 1 < args.size()) profileHz = args[++i].toInt();
+        else if(args[i] == "--coverage" && i + 1 < args.size()) coverageFile = args[++i];
+        else if(args[i] == "--coverage-merge" && i + 1 < args.size()) coverageMerges << args[++i];
+        else if(args[i] == "--immediate" && i + 1 < args.size()) immediateFile = args[++i];
+        else if(args[i] == "--lockstep" && i + 1 < args.size()) lockstepFile = args[++i];
+        else if(args[i] == "--mem-report") memReport = true;
+    }
+    QTextStream err(stderr);
+    if(programFile.isEmpty()){
+        err << "Usage: qbasic-make --headless <program> [--input <file>] [--stats-json <file>] [--cfg <file>]\n"
+            << "           [--max-steps <n>] [--max-time-ms <n>] [--max-output-lines <n>] [--max-expr-memory <bytes>]\n"
+            << "           [--max-call-depth <n>]\n"
+            << "           [--trace <file>] [--trace-sample <n>] [--trace-events <n>]\n"
+            << "           [--profile <file>] [--profile-folded <file>] [--profile-hz <n>]\n"
+            << "           [--coverage <file>] [--coverage-merge <file>]...\n"
+            << "           [--snapshot <file> --snapshot-at <line>] [--restore <file>] [--immediate <file>]\n"
+            << "           [--lockstep <file>] [--mem-report]\n";
+        return 1;
+    }
+    if(snapshotFile.isEmpty() != (snapshotLine <= 0)){
+        err << "--snapshot and --snapshot-at must be used together\n";
+        return 1;
+    }
+    if(coverageFile.isEmpty() && !coverageMerges.isEmpty()){
+        err << "--coverage-merge needs --coverage\n";
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    QFile inFile(inputFile);
+    QTextStream stdIn(stdin);
+    QTextStream fileIn(&inFile);
+    QTextStream* in = &stdIn;
+    if(!inputFile.isEmpty()){
+        if (!inFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            err << "Failed to open input file: " << inputFile << "\n";
+            return 1;
+        }
+        in = &fileIn;
+    }
+
+    qint64 heapBefore = heapInUse();
+    Program program(nullptr, true);
+    program.setStreams(in, &out);
+    program.setLimits(limits);
+    program.setTrace(traceFile, traceSample, traceEvents);
+    program.setCoverage(coverageFile, programFile);
+    if(!loadProgramFile(program, programFile)) return 1;
+    for(const QString& merge : coverageMerges){
+        if(merge == coverageFile && !QFile::exists(merge)) continue;//the first run of a batch
+        if(!program.mergeCoverage(merge)) return 1;
+    }
+    if(memReport){
+        qint64 heapLoaded = heapInUse();
+        bool parsed = program.parseAllStatements();
+        qint64 heapParsed = heapInUse();
+        out << program.memoryReport();
+        if(heapBefore >= 0){
+            qint64 n = qMax(1, program.lineCount());
+            out << "heap after load: " << (heapLoaded - heapBefore) << " bytes ("
+                << (heapLoaded - heapBefore) / n << " bytes/line)\n";
+            out << "heap after parse: " << (heapParsed - heapBefore) << " bytes ("
+                << (heapParsed - heapBefore) / n << " bytes/line)\n";
+        }
+        return parsed ? 0 : 2;
+    }
+    if(!lockstepFile.isEmpty()){
+        bool ok = runLockstep(program, lockstepFile, out, err);
+        out.flush();
+        return ok ? 0 : 2;
+    }
+    if(!snapshotFile.isEmpty()) program.setSnapshotPoint(snapshotLine, snapshotFile);
+    bool profiling = !profileFile.isEmpty() || !foldedFile.isEmpty();
+    if(profiling && !profiler.start(profileHz)){
+        err << "The profiler is not available in this build\n";
+        return 1;
+    }
+
+    bool ok;
+    if(!restoreFile.isEmpty()){
+        if(!program.loadSnapshot(restoreFile)) return 1;
+        ok = program.executeFrom(program.getPc());
+    }
+    else ok = program.execute();
+    if(!immediateFile.isEmpty()) ok = runImmediateFile(program, immediateFile) && ok;
+    if(profiling) profiler.stop();
+    out.flush();
+
+    if(!statsFile.isEmpty() && !writeTextFile(statsFile, metrics.toJson())){
+        err << "Failed to write stats file: " << statsFile << "\n";
+        return 1;
+    }
+    if(!profileFile.isEmpty() && !writeTextFile(profileFile, profiler.toText(program.lineLabels()))){
+        err << "Failed to write profile file: " << profileFile << "\n";
+        return 1;
+    }
+    if(!foldedFile.isEmpty() && !writeTextFile(foldedFile, profiler.toFolded(program.lineLabels()))){
+        err << "Failed to write profile file: " << foldedFile << "\n";
+        return 1;
+    }
+    if(!cfgFile.isEmpty() && !writeTextFile(cfgFile, program.showControlFlowGraph())){
+        err << "Failed to write CFG file: " << cfgFile << "\n";
+        return 1;
+    }
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,48 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <QStringList>
+
+class Program;
+struct ExecutionLimits;
+
+/*
+ * Headless runner: load and run a program without opening the window.
+ * Usage:
+ *   qbasic-make --headless <program> [--input <file>] [--stats-json <file>]
+ *                          [--cfg <file>] [--max-steps <n>] [--max-time-ms <n>]
+ *                          [--max-output-lines <n>] [--max-expr-memory <bytes>]
+ *                          [--max-call-depth <n>]
+ *                          [--trace <file>] [--trace-sample <n>] [--trace-events <n>]
+ *                          [--profile <file>] [--profile-folded <file>] [--profile-hz <n>]
+ *                          [--snapshot <file> --snapshot-at <line>] [--restore <file>]
+ *                          [--coverage <file>] [--coverage-merge <file>]...
+ *                          [--immediate <file>] [--lockstep <file>] [--mem-report]
+ * INPUT values are read line by line from --input (stdin by default),
+ * PRINT output goes to stdout and errors go to stderr.
+ * --cfg writes the control flow graph built for the run.
+ * The --max-* options limit the run (see ExecutionLimits).
+ * --trace writes a Chrome trace-event timeline of the run (see Tracer),
+ * --profile and --profile-folded write the report and the collapsed
+ * stacks of the sampling profiler (see Profiler).
+ * --coverage writes the lines the run executed (see Coverage), lcov if the
+ * file name ends in .info, JSON otherwise; --coverage-merge adds the lines
+ * of the JSON report of another run of the program. It may be the
+ * --coverage file itself, skipped while it does not exist, so that one
+ * report covers a batch of runs.
+ * --snapshot saves the state and stops when the run reaches --snapshot-at,
+ * --restore resumes the run from a saved state.
+ * --immediate executes the PRINT, LET, INPUT and DIM commands of a file
+ * after the run, with the variables it left.
+ * --lockstep runs the program once per input set of a file, the sets
+ * separated by "---" lines, all at once (see Lockstep); the output and the
+ * errors of each run follow a "--- <n>" line.
+ * --mem-report loads and parses the program without running it and prints
+ * the memory used per line.
+*/
+int runHeadless(const QStringList& args);
+
+bool loadProgramText(Program& program, const QString& text);
+bool parseLimitOption(const QStringList& args, int& i, ExecutionLimits& limits);
+
+#endif // HEADLESS_H
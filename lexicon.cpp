@@ -0,0 +1,111 @@
+#include "lexicon.h"
+
+namespace {
+
+struct KeywordEntry
+{
+    const char* text;
+    int length;
+    Keyword keyword;
+};
+
+constexpr KeywordEntry keywordList[] = {
+    {"LOAD", 4, loadKw}, {"RUN", 3, runKw}, {"CLEAR", 5, clearKw}, {"QUIT", 4, quitKw},
+    {"LIST", 4, listKw}, {"ADD", 3, addKw}, {"DELETE", 6, deleteKw}, {"PRINT", 5, printKw},
+    {"LET", 3, letKw}, {"INPUT", 5, inputKw}, {"GOTO", 4, gotoKw}, {"IF", 2, ifKw},
+    {"THEN", 4, thenKw}, {"END", 3, endKw}, {"REM", 3, remKw}, {"DIM", 3, dimKw},
+    {"FOR", 3, forKw}, {"TO", 2, toKw}, {"STEP", 4, stepKw}, {"NEXT", 4, nextKw},
+    {"GOSUB", 5, gosubKw}, {"RETURN", 6, returnKw}, {"MOD", 3, modKw},
+    {"STATS", 5, statsKw}, {"CFG", 3, cfgKw}, {"SNAPSHOT", 8, snapshotKw},
+    {"RESTORE", 7, restoreKw}, {"HELP", 4, helpKw}, {"RESET", 5, resetKw},
+    {"TRACE", 5, traceKw}, {"COVERAGE", 8, coverageKw},
+};
+constexpr int keywordCount = sizeof(keywordList) / sizeof(keywordList[0]);
+constexpr int maxKeywordLength = 8;
+
+/*
+ * Perfect hash: a seeded FNV-1a over the characters, reduced to a table
+ * slot. The seed is searched at compile time so that no two keywords share
+ * a slot; a lookup then hashes once and compares against one candidate.
+*/
+constexpr int hashTableSize = 128;
+
+constexpr unsigned keywordHash(const char* s, int length, unsigned seed)
+{
+    unsigned h = 2166136261u ^ seed;
+    for(int i = 0; i < length; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return (h ^ (h >> 15)) & (hashTableSize - 1);
+}
+
+inline unsigned keywordHash(const QChar* s, int length, unsigned seed)
+{
+    unsigned h = 2166136261u ^ seed;
+    for(int i = 0; i < length; i++) h = (h ^ s[i].unicode()) * 16777619u;
+    return (h ^ (h >> 15)) & (hashTableSize - 1);
+}
+
+struct HashTable
+{
+    bool found;
+    unsigned seed;
+    signed char entries[hashTableSize];//index in keywordList, -1 if empty
+};
+
+constexpr HashTable buildHashTable()
+{
+    for(unsigned seed = 0; seed < 100000; seed++){
+        HashTable table{true, seed, {}};
+        for(auto& entry : table.entries) entry = -1;
+        bool collision = false;
+        for(int i = 0; i < keywordCount && !collision; i++){
+            unsigned h = keywordHash(keywordList[i].text, keywordList[i].length, seed);
+            if(table.entries[h] >= 0) collision = true;
+            else table.entries[h] = i;
+        }
+        if(!collision) return table;
+    }
+    return HashTable{false, 0, {}};
+}
+
+constexpr HashTable hashTable = buildHashTable();
+static_assert(hashTable.found, "no perfect hash seed found for the keywords");
+
+}
+
+/* keywordOf
+* The keyword spelled by s[0, length), noKeyword if it is not one.
+* Keywords are case sensitive.
+*/
+Keyword keywordOf(const QChar* s, int length)
+{
+    if(length < 2 || length > maxKeywordLength) return noKeyword;
+    int index = hashTable.entries[keywordHash(s, length, hashTable.seed)];
+    if(index < 0) return noKeyword;
+    const KeywordEntry& entry = keywordList[index];
+    if(entry.length != length) return noKeyword;
+    for(int i = 0; i < length; i++)
+        if(s[i].unicode() != (unsigned char)entry.text[i]) return noKeyword;
+    return entry.keyword;
+}
+
+/* isValidName
+* Check if name is a valid variable name.
+* Rules:
+* 1. Must start with a letter or underscore
+* 2. Can only contain letters, numbers, and underscores
+* 3. Cannot be a reserved keyword
+* Characters outside ASCII are classified by QChar.
+*/
+bool isValidName(const QString& name)
+{
+    if (name.isEmpty()) return false;
+    QChar first = name[0];
+    if (first.unicode() < 128 ? !isCharClass(first, letterChar | underscoreChar) : !first.isLetter())
+        return false;
+    for (int i = 1; i < name.length(); i++) {
+        QChar c = name[i];
+        if (c.unicode() < 128 ? !isCharClass(c, letterChar | digitChar | underscoreChar) : !c.isLetterOrNumber())
+            return false;
+    }
+    return !isReserved(keywordOf(name));
+}
@@ -0,0 +1,97 @@
+#ifndef LEXICON_H
+#define LEXICON_H
+
+#include <QString>
+
+/*
+ * Lexicon
+ * The words and character classes of QBasic, shared by the tokenizer,
+ * the statement parser and the command line.
+ * Keywords are found with a perfect hash built at compile time, characters
+ * are classified with a table of the ASCII range.
+*/
+
+enum Keyword : unsigned char{
+    noKeyword,
+    //statements, commands and operators, reserved as variable names
+    loadKw,
+    runKw,
+    clearKw,
+    quitKw,
+    listKw,
+    addKw,
+    deleteKw,
+    printKw,
+    letKw,
+    inputKw,
+    gotoKw,
+    ifKw,
+    thenKw,
+    endKw,
+    remKw,
+    dimKw,
+    forKw,
+    toKw,
+    stepKw,
+    nextKw,
+    gosubKw,
+    returnKw,
+    modKw,
+    //commands of the command line only, allowed as variable names
+    statsKw,
+    cfgKw,
+    snapshotKw,
+    restoreKw,
+    helpKw,
+    resetKw,
+    traceKw,
+    coverageKw,
+};
+
+Keyword keywordOf(const QChar* s, int length);
+inline Keyword keywordOf(const QString& s) { return keywordOf(s.constData(), s.size()); }
+inline bool isReserved(Keyword keyword) { return keyword >= loadKw && keyword <= modKw; }
+
+/*
+ * Classes of the ASCII characters, a character may be in several classes.
+*/
+enum CharFlag : unsigned char{
+    letterChar = 1,
+    digitChar = 2,
+    underscoreChar = 4,
+    blankChar = 8,//' ', '\t' ... '\r'
+    operatorChar = 16,//+ - * /
+    bracketChar = 32,
+};
+
+struct CharTable
+{
+    unsigned char flags[128];
+};
+
+constexpr CharTable makeCharTable()
+{
+    CharTable table{};
+    for(int c = 'a'; c <= 'z'; c++) table.flags[c] |= letterChar;
+    for(int c = 'A'; c <= 'Z'; c++) table.flags[c] |= letterChar;
+    for(int c = '0'; c <= '9'; c++) table.flags[c] |= digitChar;
+    for(int c = '\t'; c <= '\r'; c++) table.flags[c] |= blankChar;
+    table.flags[int(' ')] |= blankChar;
+    table.flags[int('_')] |= underscoreChar;
+    for(char c : {'+', '-', '*', '/'}) table.flags[int(c)] |= operatorChar;
+    table.flags[int('(')] |= bracketChar;
+    table.flags[int(')')] |= bracketChar;
+    return table;
+}
+
+inline constexpr CharTable charTable = makeCharTable();
+
+//true if c is an ASCII character in one of the classes of flags
+inline bool isCharClass(QChar c, unsigned char flags)
+{
+    return c.unicode() < 128 && (charTable.flags[c.unicode()] & flags) != 0;
+}
+
+bool isValidName(const QString& name);//a variable name: identifier that is not reserved
+
+#endif // LEXICON_H
@@ -0,0 +1,112 @@
+#include "loader.h"
+#include "scanner.h"
+#include <QByteArray>
+#include <QFile>
+#include <QThreadPool>
+
+/* splitProgramLine
+* Split a trimmed "<line> <statement>" program line. Return false if it
+* does not start with a line number; the statement may be empty.
+*/
+bool splitProgramLine(const QString& text, int& line, QString& statement)
+{
+    int firstSpaceIndex = text.indexOf(' ');
+    line = text.left(firstSpaceIndex).toInt();
+    statement = firstSpaceIndex != -1 ? text.mid(firstSpaceIndex + 1).trimmed() : QString();
+    return line > 0;
+}
+
+ProgramLoader::ProgramLoader(const QString& filename)
+    : filename(filename)
+{
+}
+
+ProgramLoader::~ProgramLoader()
+{
+    cancel();
+    wait();
+}
+
+/* ProgramLoader::start
+* Start the load on a thread of the global pool.
+*/
+void ProgramLoader::start()
+{
+    if(started.exchange(true)) return;
+    QThreadPool::globalInstance()->start([this] {
+        load();
+        finished = true;
+        done.release();
+    });
+}
+
+/* ProgramLoader::wait
+* Wait until the load is finished, if it was started.
+*/
+void ProgramLoader::wait()
+{
+    if(!started) return;
+    done.acquire();
+    done.release();
+}
+
+/* ProgramLoader::load
+* Read the file a block at a time and add its lines to the version, each
+* line once it is complete. Stop at the first line that is not a program
+* line, or when the load is cancelled.
+*/
+void ProgramLoader::load()
+{
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly)){
+        error = "Failed to open file: " + filename;
+        return;
+    }
+    totalBytes = file.size();
+    QByteArray rest;//the start of a line the last block cut
+    for(;;){
+        QByteArray block = file.read(blockSize);
+        bool last = block.isEmpty();
+        QByteArray text = rest + block;
+        int begin = 0;
+        while(begin < text.size() && !cancelled){
+            int end = text.indexOf('\n', begin);
+            if(end < 0 && !last) break;
+            if(end < 0) end = text.size();
+            if(!addLine(QString::fromUtf8(text.constData() + begin, end - begin))) return;
+            bytesRead += qMin<qint64>(end + 1, text.size()) - begin;
+            linesRead++;
+            begin = end + 1;
+        }
+        if(last || cancelled) return;
+        rest = text.mid(begin);
+    }
+}
+
+/* ProgramLoader::addLine
+* Add a line of the file to the version, as Program::updateStatement
+* does. Blank lines are skipped.
+*/
+bool ProgramLoader::addLine(const QString& text)
+{
+    QString trimmed = text.trimmed();
+    if(trimmed.isEmpty()) return true;
+    int line;
+    QString statement;
+    if(!splitProgramLine(trimmed, line, statement)){
+        error = "Invalid program line: " + trimmed;
+        return false;
+    }
+    if(statement.isEmpty()){
+        version = version.without(line);
+        return true;
+    }
+    try{
+        version = version.with(line, Scanner::collapseSpaces(statement));
+    }
+    catch(std::exception&){
+        error = "Invalid program line: " + trimmed;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <QSemaphore>
+#include <QString>
+#include <atomic>
+#include "version.h"
+
+/*
+ * ProgramLoader
+ * Reads a program file on a thread of the global pool, so that a large
+ * file does not hold up the window. The lines go into a ProgramVersion of
+ * their own: the program the load is for is not touched until the load is
+ * done and the caller sets the version (see Program::setVersion), in one
+ * step. The caller polls the bytes and lines read so far, and can cancel
+ * the load, which stops it at the next line.
+*/
+class ProgramLoader
+{
+public:
+    explicit ProgramLoader(const QString& filename);
+    ProgramLoader(const ProgramLoader&) = delete;
+    ProgramLoader& operator=(const ProgramLoader&) = delete;
+    ~ProgramLoader();//cancels the load and waits for its thread
+    void start();
+    void cancel() { cancelled = true; }
+    void wait();
+    bool isFinished() const { return finished; }
+    bool isCancelled() const { return cancelled; }
+    qint64 getBytesRead() const { return bytesRead; }
+    qint64 getTotalBytes() const { return totalBytes; }
+    int getLinesRead() const { return linesRead; }
+/* Set once the load is finished: what stopped it (empty if nothing did)
+ * and the program read.*/
+    const QString& getError() const { return error; }
+    const ProgramVersion& getVersion() const { return version; }
+
+private:
+    static const int blockSize = 1 << 20;//bytes read from the file at a time
+    QString filename;
+    std::atomic<bool> started{false};
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> finished{false};
+    std::atomic<qint64> bytesRead{0};
+    std::atomic<qint64> totalBytes{0};
+    std::atomic<int> linesRead{0};
+    QSemaphore done;//released when the thread is finished
+    QString error;
+    ProgramVersion version;
+    void load();
+    bool addLine(const QString& text);
+};
+
+bool splitProgramLine(const QString& text, int& line, QString& statement);
+
+#endif // LOADER_H
@@ -0,0 +1,738 @@
+#include "lockstep.h"
+#include "statement.h"
+#include "expression.h"
+#include "metrics.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define LOCKSTEP_X86
+#include <immintrin.h>
+#endif
+
+//Statements executed between two checks of the wall time limit.
+static const int timeCheckInterval = 4096;
+
+namespace {
+
+/*
+ * Lane kernels: one operator over n lanes. The arithmetic wraps around
+ * like the two's complement instructions the scalar interpreter compiles
+ * to, so both give the same results on overflow.
+*/
+template<ExpOperation op>
+inline int combine(int a, int b)
+{
+    switch(op){
+    case ExpOperation::add: return int(unsigned(a) + unsigned(b));
+    case ExpOperation::sub: return int(unsigned(a) - unsigned(b));
+    default: return int(unsigned(a) * unsigned(b));
+    }
+}
+
+template<ExpOperation op>
+void combineScalar(const int* a, const int* b, int* out, int n)
+{
+    for(int i = 0; i < n; i++) out[i] = combine<op>(a[i], b[i]);
+}
+
+template<char condOpt>
+inline int compare(int a, int b)
+{
+    return condOpt == '=' ? a == b : condOpt == '>' ? a > b : a < b;
+}
+
+template<char condOpt>
+void compareScalar(const int* a, const int* b, int* out, int n)
+{
+    for(int i = 0; i < n; i++) out[i] = compare<condOpt>(a[i], b[i]);
+}
+
+void gatherScalar(const int* column, const int* lanes, int* out, int n)
+{
+    for(int i = 0; i < n; i++) out[i] = column[lanes[i]];
+}
+
+#ifdef LOCKSTEP_X86
+template<ExpOperation op>
+__attribute__((target("avx2"))) void combineAvx2(const int* a, const int* b, int* out, int n)
+{
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i z;
+        if(op == ExpOperation::add) z = _mm256_add_epi32(x, y);
+        else if(op == ExpOperation::sub) z = _mm256_sub_epi32(x, y);
+        else z = _mm256_mullo_epi32(x, y);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), z);
+    }
+    for(; i < n; i++) out[i] = combine<op>(a[i], b[i]);
+}
+
+template<char condOpt>
+__attribute__((target("avx2"))) void compareAvx2(const int* a, const int* b, int* out, int n)
+{
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i mask;
+        if(condOpt == '=') mask = _mm256_cmpeq_epi32(x, y);
+        else if(condOpt == '>') mask = _mm256_cmpgt_epi32(x, y);
+        else mask = _mm256_cmpgt_epi32(y, x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_srli_epi32(mask, 31));
+    }
+    for(; i < n; i++) out[i] = compare<condOpt>(a[i], b[i]);
+}
+
+__attribute__((target("avx2"))) void gatherAvx2(const int* column, const int* lanes, int* out, int n)
+{
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(column, index, 4));
+    }
+    for(; i < n; i++) out[i] = column[lanes[i]];
+}
+#endif
+
+bool detectAvx2()
+{
+#ifdef LOCKSTEP_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+bool avx2Enabled = Lockstep::hasAvx2();
+
+template<ExpOperation op>
+void combineLanes(const int* a, const int* b, int* out, int n)
+{
+#ifdef LOCKSTEP_X86
+    if(avx2Enabled) return combineAvx2<op>(a, b, out, n);
+#endif
+    combineScalar<op>(a, b, out, n);
+}
+
+template<char condOpt>
+void compareLanes(const int* a, const int* b, int* out, int n)
+{
+#ifdef LOCKSTEP_X86
+    if(avx2Enabled) return compareAvx2<condOpt>(a, b, out, n);
+#endif
+    compareScalar<condOpt>(a, b, out, n);
+}
+
+void gatherLanes(const int* column, const int* lanes, int* out, int n)
+{
+#ifdef LOCKSTEP_X86
+    if(avx2Enabled) return gatherAvx2(column, lanes, out, n);
+#endif
+    gatherScalar(column, lanes, out, n);
+}
+
+/* errorText
+* An error line as Program::reportError writes it.
+*/
+QString errorText(const QString& message)
+{
+    return "Error: " + message + "\n";
+}
+
+QString errorText(const Status& status)
+{
+    return errorText(QString("Line %1: %2").arg(status.getLine()).arg(status.message()));
+}
+
+}
+
+Lockstep::Lockstep(Program* program) : program(program)
+{
+}
+
+bool Lockstep::hasAvx2()
+{
+    static const bool supported = detectAvx2();
+    return supported;
+}
+
+void Lockstep::setAvx2(bool enabled)
+{
+    avx2Enabled = enabled && hasAvx2();
+}
+
+/* Lockstep::run
+* Run the program once per input set, from its first line. The program is
+* parsed and its execution plan built (see Program::executeLockstep).
+* Return false if an instance failed.
+*/
+bool Lockstep::run(const std::vector<QStringList>& inputs, std::vector<LockstepResult>& results)
+{
+    results.assign(inputs.size(), LockstepResult());
+    //the operands of a statement never take more entries than its nodes
+    int entries = 0;
+    for(const Statement* stmt : program->plan) entries = std::max(entries, stmt->getNodeCount());
+    for(int first = 0; first < (int)inputs.size(); first += lanesPerBlock){
+        int count = std::min(lanesPerBlock, (int)inputs.size() - first);
+        scratch.assign((size_t)(entries + 2) * count, 0);//and the results and the IF outcomes
+        scratchTop = 0;
+        try{
+            runBlock(inputs, results, first, count);
+        }
+        catch(std::exception& e){
+            //only allocation failures are thrown
+            for(int lane : active)
+                if(lanes[lane].index >= 0 && lanes[lane].index < program->plan.size())
+                    finish(lane, errorText(QString("Line %1: %2").arg(program->plan[lanes[lane].index]->line).arg(e.what())));
+        }
+    }
+    return std::all_of(results.begin(), results.end(), [](const LockstepResult& r){ return r.ok; });
+}
+
+/* Lockstep::runBlock
+* Run the instances [first, first + count) to the end.
+*/
+void Lockstep::runBlock(const std::vector<QStringList>& inputs, std::vector<LockstepResult>& results, int first, int count)
+{
+    width = count;
+    size_t cells = program->variables.size() * (size_t)width;
+    values.assign(cells, 0);
+    states.assign(cells, undefinedState);
+    arrays.clear();
+    arrays.resize(cells);
+    int entry = program->statements.find(program->pc)->planIndex;
+    lanes.clear();
+    active.clear();
+    for(int lane = 0; lane < width; lane++){
+        lanes.push_back(Lane{entry, 0, 0, 0, 0, {}, &inputs[first + lane], &results[first + lane]});
+        active.push_back(lane);
+    }
+    loops.resize((size_t)width * Program::maxLoopDepth);
+    statuses.assign(width, Status());
+
+    const ExecutionLimits& limits = program->limits;
+    bool regroup = true;
+    int timeCountdown = timeCheckInterval;
+    while(!active.empty()){
+        if(regroup) formGroup();
+        int index = lanes[group[0]].index;
+        if(index >= program->plan.size()){
+            //past the last statement: the program ends
+            for(int lane : group) finish(lane);
+            dropFinished();
+            regroup = true;
+            continue;
+        }
+        Statement* stmt = program->plan[index];
+        bool stopped = false;
+        if(limits.maxSteps){
+            for(int lane : group){
+                if(lanes[lane].steps < limits.maxSteps) continue;
+                fail(lane, ErrorCode::stepLimit, QString(), limits.maxSteps);
+                statuses[lane].setLine(stmt->line);
+                finish(lane, errorText(statuses[lane]));
+                stopped = true;
+            }
+        }
+        if(limits.maxWallMs && --timeCountdown == 0){
+            timeCountdown = timeCheckInterval;
+            if(program->runTimer.elapsed() > limits.maxWallMs){
+                for(int lane : active){
+                    if(lanes[lane].index < 0) continue;
+                    if(lanes[lane].index >= program->plan.size()){
+                        finish(lane);
+                        continue;
+                    }
+                    fail(lane, ErrorCode::timeLimit, QString(), limits.maxWallMs);
+                    statuses[lane].setLine(program->plan[lanes[lane].index]->line);
+                    finish(lane, errorText(statuses[lane]));
+                }
+                stopped = true;
+            }
+        }
+        if(stopped){
+            //lanes stopped by a limit: group the others again
+            dropFinished();
+            regroup = true;
+            continue;
+        }
+        for(int lane : group) lanes[lane].steps++;
+        METRIC_ADD(statementsExecuted, group.size());
+        if(program->coverage.isEnabled()) program->coverage.hit(index);
+
+        int* next = push();
+        execute(stmt, next);
+        bool finished = false;
+        int nextIndex = -1;
+        bool uniform = true;
+        for(int i = 0; i < (int)group.size(); i++){
+            int lane = group[i];
+            if(statuses[lane].ok()) advance(lane, stmt, next[i]);
+            if(!statuses[lane].ok()){
+                statuses[lane].setLine(stmt->line);
+                finish(lane, errorText(statuses[lane]));
+            }
+            int laneIndex = lanes[lane].index;
+            if(laneIndex < 0) finished = true;
+            else if(nextIndex < 0) nextIndex = laneIndex;
+            else if(laneIndex != nextIndex) uniform = false;
+        }
+        scratchTop = 0;
+        regroup = finished || !uniform || group.size() != active.size();
+        if(finished)
+            dropFinished();
+    }
+}
+
+/* Lockstep::dropFinished
+* Remove the lanes that ended from the running ones.
+*/
+void Lockstep::dropFinished()
+{
+    active.erase(std::remove_if(active.begin(), active.end(), [this](int lane){ return lanes[lane].index < 0; }), active.end());
+}
+
+/* Lockstep::formGroup
+* Group the running lanes at the lowest plan index.
+*/
+void Lockstep::formGroup()
+{
+    int index = INT_MAX;
+    for(int lane : active) index = std::min(index, lanes[lane].index);
+    group.clear();
+    for(int lane : active) if(lanes[lane].index == index) group.push_back(lane);
+    contiguous = group.back() - group.front() + 1 == (int)group.size();
+}
+
+int* Lockstep::push()
+{
+    int* entry = scratch.data() + scratchTop;
+    scratchTop += width;
+    return entry;
+}
+
+/* Lockstep::execute
+* Execute stmt for the group, as Statement::execute does for one run, and
+* store what it returns for every lane in next.
+*/
+void Lockstep::execute(Statement* stmt, int* next)
+{
+    int n = group.size();
+    std::fill(next, next + n, 0);
+    switch(stmt->type){
+    case StatementType::printStmt:{
+        const int* result = evaluate(stmt->expressions[0]);
+        for(int i = 0; i < n; i++)
+            if(statuses[group[i]].ok()) output(group[i], result[i]);
+        break;
+    }
+    case StatementType::inputStmt:
+        for(int i = 0; i < n; i++) input(group[i], stmt->varSlot);
+        break;
+    case StatementType::letStmt:{
+        const int* result = evaluate(stmt->expressions[0]);
+        if(stmt->expressions[1] != nullptr){
+            //the index of the element, see Expression::store
+            const Expression* target = stmt->expressions[1];
+            const int* index = evaluate(target, 1, target->tape.size() - 1);
+            for(int i = 0; i < n; i++){
+                int* element = this->element(group[i], target->root, index[i]);
+                if(element != nullptr) *element = result[i];
+            }
+        }
+        else{
+            for(int i = 0; i < n; i++)
+                if(statuses[group[i]].ok()) setVariable(group[i], stmt->varSlot, result[i]);
+        }
+        break;
+    }
+    case StatementType::dimStmt:{
+        const int* size = evaluate(stmt->expressions[0]);
+        const Program::Variable& var = program->variables[stmt->varSlot];
+        for(int i = 0; i < n; i++){
+            int lane = group[i];
+            if(!statuses[lane].ok()) continue;
+            if(size[i] <= 0 || size[i] > Program::maxArraySize){
+                fail(lane, ErrorCode::invalidArraySize, *var.name, size[i]);
+                continue;
+            }
+            size_t cell = (size_t)stmt->varSlot * width + lane;
+            arrays[cell].assign(size[i], 0);
+            states[cell] = arrayState;
+        }
+        break;
+    }
+    case StatementType::forStmt:{
+        if(stmt->target == 0){
+            failGroup(ErrorCode::forWithoutNext);
+            break;
+        }
+        const int* start = evaluate(stmt->expressions[0]);
+        const int* limit = evaluate(stmt->expressions[1]);
+        const int* step = nullptr;
+        if(stmt->expressions[2] != nullptr) step = evaluate(stmt->expressions[2]);
+        for(int i = 0; i < n; i++){
+            int lane = group[i];
+            if(!statuses[lane].ok()) continue;
+            setVariable(lane, stmt->varSlot, start[i]);
+            if(!statuses[lane].ok()) continue;
+            if(enterLoop(lane, stmt->line, stmt->varSlot, limit[i], step != nullptr ? step[i] : 1)) next[i] = 0;
+            else next[i] = stmt->jumpLine > 0 ? stmt->jumpLine : -2;
+        }
+        break;
+    }
+    case StatementType::nextStmt:
+        if(stmt->target == 0){
+            failGroup(ErrorCode::nextWithoutFor);
+            break;
+        }
+        for(int i = 0; i < n; i++)
+            next[i] = nextIteration(group[i], stmt->target) ? stmt->jumpLine : 0;
+        break;
+    case StatementType::gotoStmt:
+        std::fill(next, next + n, stmt->jumpLine);
+        break;
+    case StatementType::gosubStmt:
+        for(int i = 0; i < n; i++){
+            Lane& lane = lanes[group[i]];
+            next[i] = stmt->jumpLine;
+            if((int)lane.calls.size() == (int)program->calls.size()){
+                fail(group[i], ErrorCode::tooManyCalls, QString(), program->calls.size());
+                continue;
+            }
+            lane.calls.push_back({stmt->line, stmt->planIndex + 1, lane.loopDepth});
+        }
+        break;
+    case StatementType::returnStmt:
+        std::fill(next, next + n, -3);
+        break;
+    case StatementType::ifStmt:{
+        const int* left = evaluate(stmt->expressions[0]);
+        const int* right = evaluate(stmt->expressions[1]);
+        int* taken = push();
+        if(stmt->condOpt == '=') compareLanes<'='>(left, right, taken, n);
+        else if(stmt->condOpt == '>') compareLanes<'>'>(left, right, taken, n);
+        else if(stmt->condOpt == '<') compareLanes<'<'>(left, right, taken, n);
+        else failGroup(ErrorCode::invalidOperator);
+        for(int i = 0; i < n; i++) next[i] = taken[i] ? stmt->jumpLine : 0;
+        break;
+    }
+    case StatementType::endStmt:
+        std::fill(next, next + n, -2);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Lockstep::advance
+* Move lane to the statement after stmt, given what stmt returned for it
+* (see Program::runPlan).
+*/
+void Lockstep::advance(int lane, Statement* stmt, int retpc)
+{
+    Lane& state = lanes[lane];
+    if(retpc == 0) state.index++;
+    else if(retpc == -2) finish(lane);
+    else if(retpc == -3){
+        if(state.calls.empty()){
+            fail(lane, ErrorCode::returnWithoutGosub);
+            return;
+        }
+        const Program::CallFrame& call = state.calls.back();
+        state.loopDepth = call.loopMark;
+        state.index = call.returnIndex;
+        state.calls.pop_back();
+    }
+    else if(stmt->jumpIndex < 0){
+        QString jump = stmt->type == StatementType::gosubStmt ? "GOSUB" : "GOTO";
+        finish(lane, errorText(QString("Invalid %1 line number %2 on Line %3").arg(jump).arg(retpc).arg(stmt->line)));
+    }
+    else state.index = stmt->jumpIndex;
+}
+
+/* Lockstep::evaluate
+* The value of the entries first ... last - 1 of the tape of exp for every
+* lane of the group, as Expression::evaluate computes it (without the
+* memoization). Lanes that fail get their status set and an undefined
+* value. Every value on the stack is a column of the group on the operand
+* stack, or straight in a variable column; a result takes the place of
+* its first operand on the operand stack. The result stays there.
+*/
+const int* Lockstep::evaluate(const Expression* exp, int first, int last)
+{
+    int n = group.size();
+    operands.clear();
+    const TapeEntry* tape = exp->tape.data();
+    for(int pc = first; pc < last; pc++){
+        const TapeEntry& entry = tape[pc];
+        switch(entry.op){
+        case numberOp:{
+            int top = scratchTop;
+            int* result = push();
+            std::fill(result, result + n, entry.operand);
+            operands.push_back({result, top});
+            break;
+        }
+        case variableOp:{
+            int top = scratchTop;
+            operands.push_back({readVariable(entry.node), top});
+            break;
+        }
+        case elementOp:{
+            Operand& index = operands.back();
+            scratchTop = index.top;
+            int* result = push();
+            readElement(entry.node, index.values, result);
+            index.values = result;
+            break;
+        }
+        case operationOp:
+        case operationNumberOp:
+        case operationVariableOp:{
+            const int* right;
+            if(entry.op == operationOp){
+                right = operands.back().values;
+                operands.pop_back();
+            }
+            else if(entry.op == operationNumberOp){
+                int* column = push();
+                std::fill(column, column + n, entry.operand);
+                right = column;
+            }
+            else right = readVariable(entry.node->right);
+            Operand& left = operands.back();
+            scratchTop = left.top;
+            int* result = push();
+            operate(entry.opt, left.values, right, result);
+            left.values = result;
+            break;
+        }
+        case memoOp:
+            break;
+        }
+    }
+    return operands.back().values;
+}
+
+const int* Lockstep::readVariable(const ExpressionNode* node)
+{
+    int n = group.size();
+    if(!program->variables[node->slot].validName) failGroup(ErrorCode::invalidVariableName, *node->name);
+    size_t column = (size_t)node->slot * width;
+    const unsigned char* state = states.data() + column;
+    for(int i = 0; i < n; i++){
+        if(state[group[i]] == valueState) continue;
+        fail(group[i], state[group[i]] == arrayState ? ErrorCode::arrayAsVariable : ErrorCode::variableNotFound, *node->name);
+    }
+    if(contiguous) return values.data() + column + group[0];
+    int* result = push();
+    gatherLanes(values.data() + column, group.data(), result, n);
+    return result;
+}
+
+/* Lockstep::readElement
+* The elements of the array of node at index, for every lane. result may
+* be index.
+*/
+void Lockstep::readElement(const ExpressionNode* node, const int* index, int* result)
+{
+    int n = group.size();
+    for(int i = 0; i < n; i++){
+        const int* element = this->element(group[i], node, index[i]);
+        result[i] = element != nullptr ? *element : 0;
+    }
+}
+
+/* Lockstep::element
+* The element of the array of node at index in lane, nullptr if it fails
+* (see Expression::element). The index is always checked.
+*/
+int* Lockstep::element(int lane, const ExpressionNode* node, int index)
+{
+    if(!statuses[lane].ok()) return nullptr;
+    if(!program->variables[node->slot].validName){
+        fail(lane, ErrorCode::invalidVariableName, *node->name);
+        return nullptr;
+    }
+    size_t cell = (size_t)node->slot * width + lane;
+    if(states[cell] != arrayState){
+        fail(lane, ErrorCode::arrayNotDimensioned, *node->name);
+        return nullptr;
+    }
+    std::vector<int>& elements = arrays[cell];
+    if((unsigned)index >= elements.size()){
+        fail(lane, ErrorCode::indexOutOfRange, *node->name, index);
+        return nullptr;
+    }
+    return &elements[index];
+}
+
+/* Lockstep::operate
+* left opt right for every lane. result may be left or right.
+*/
+void Lockstep::operate(ExpOperation opt, const int* left, const int* right, int* result)
+{
+    int n = group.size();
+    switch(opt){
+    case ExpOperation::add: combineLanes<ExpOperation::add>(left, right, result, n); break;
+    case ExpOperation::sub: combineLanes<ExpOperation::sub>(left, right, result, n); break;
+    case ExpOperation::mul: combineLanes<ExpOperation::mul>(left, right, result, n); break;
+    default:
+        //lane by lane, skipping the lanes that failed: their operands are
+        //not values the scalar run would divide
+        for(int i = 0; i < n; i++){
+            int lane = group[i];
+            int value = 0;
+            if(!statuses[lane].ok()){
+                result[i] = value;
+                continue;
+            }
+            if(opt == ExpOperation::power){
+                long long power = pow(left[i], right[i]);
+                value = power;
+            }
+            else if(right[i] == 0) fail(lane, ErrorCode::divisionByZero);
+            else if(opt == ExpOperation::divide) value = left[i] / right[i];
+            else value = Expression::myMod(left[i], right[i]);
+            result[i] = value;
+        }
+        break;
+    }
+}
+
+/* Lockstep::setVariable
+* Store value in the variable slot of lane (see Program::setVariable).
+*/
+void Lockstep::setVariable(int lane, int slot, int value)
+{
+    size_t cell = (size_t)slot * width + lane;
+    if(states[cell] == arrayState){
+        fail(lane, ErrorCode::arrayAsVariable, *program->variables[slot].name);
+        return;
+    }
+    values[cell] = value;
+    states[cell] = valueState;
+}
+
+/* Lockstep::input
+* Read the next value of the input set of lane into the variable slot
+* (see Program::input).
+*/
+void Lockstep::input(int lane, int slot)
+{
+    const Program::Variable& var = program->variables[slot];
+    if(!var.validName){
+        fail(lane, ErrorCode::invalidVariableName, *var.name);
+        return;
+    }
+    Lane& state = lanes[lane];
+    if(state.inputLine >= state.input->size()){
+        fail(lane, ErrorCode::noInputLeft, *var.name);
+        return;
+    }
+    QString line = state.input->at(state.inputLine++).trimmed();
+    if(line.startsWith("?")) line = line.mid(1);
+    bool ok;
+    int value = line.toInt(&ok);
+    if(!ok){
+        fail(lane, ErrorCode::invalidInput, line);
+        return;
+    }
+    setVariable(lane, slot, value);
+}
+
+void Lockstep::output(int lane, int value)
+{
+    Lane& state = lanes[lane];
+    qint64 maxLines = program->limits.maxOutputLines;
+    if(maxLines && ++state.outputLines > maxLines){
+        fail(lane, ErrorCode::outputLimit, QString(), maxLines);
+        return;
+    }
+    state.result->output += QString::number(value) + "\n";
+}
+
+int Lockstep::loopBase(int lane) const
+{
+    const Lane& state = lanes[lane];
+    return state.calls.empty() ? 0 : state.calls.back().loopMark;
+}
+
+/* Lockstep::enterLoop
+* Program::enterLoop for lane.
+*/
+bool Lockstep::enterLoop(int lane, int forLine, int slot, int limit, int step)
+{
+    Lane& state = lanes[lane];
+    for(int depth = state.loopDepth; depth > loopBase(lane); depth--){
+        if(frame(lane, depth - 1).forLine == forLine){
+            state.loopDepth = depth - 1;
+            break;
+        }
+    }
+    int start = values[(size_t)slot * width + lane];
+    if(step >= 0 ? start > limit : start < limit) return false;
+    if(state.loopDepth == Program::maxLoopDepth){
+        fail(lane, ErrorCode::tooManyLoops, QString(), Program::maxLoopDepth);
+        return false;
+    }
+    frame(lane, state.loopDepth++) = {forLine, slot, limit, step};
+    return true;
+}
+
+/* Lockstep::nextIteration
+* Program::nextIteration for lane.
+*/
+bool Lockstep::nextIteration(int lane, int forLine)
+{
+    Lane& state = lanes[lane];
+    int base = loopBase(lane);
+    while(state.loopDepth > base && frame(lane, state.loopDepth - 1).forLine != forLine) state.loopDepth--;
+    if(state.loopDepth == base){
+        fail(lane, ErrorCode::nextWithoutFor);
+        return false;
+    }
+    const Program::LoopFrame& loop = frame(lane, state.loopDepth - 1);
+    size_t cell = (size_t)loop.slot * width + lane;
+    if(states[cell] == arrayState){
+        fail(lane, ErrorCode::arrayAsVariable, *program->variables[loop.slot].name);
+        return false;
+    }
+    long long value = (long long)values[cell] + loop.step;
+    values[cell] = (int)value;
+    if(loop.step >= 0 ? value <= loop.limit : value >= loop.limit) return true;
+    state.loopDepth--;
+    return false;
+}
+
+/* Lockstep::fail
+* Set the status of lane, unless an earlier error of the statement did:
+* the scalar run stops at the first one.
+*/
+void Lockstep::fail(int lane, ErrorCode code, const QString& subject, long long number)
+{
+    if(statuses[lane].ok()) statuses[lane].fail(code, subject, number);
+}
+
+void Lockstep::failGroup(ErrorCode code, const QString& subject, long long number)
+{
+    for(int lane : group) fail(lane, code, subject, number);
+}
+
+/* Lockstep::finish
+* End the run of lane, with error as what it reported.
+*/
+void Lockstep::finish(int lane, const QString& error)
+{
+    lanes[lane].index = -1;
+    if(error.isEmpty()) return;
+    lanes[lane].result->errors += error;
+    lanes[lane].result->ok = false;
+}
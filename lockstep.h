@@ -0,0 +1,108 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include "program.h"
+
+/* What one instance of a lockstep run printed and reported.*/
+struct LockstepResult
+{
+    QString output;//PRINT lines
+    QString errors;//"<title>: <message>" lines, as Program::reportError writes them
+    bool ok = true;
+};
+
+/*
+ * Lockstep
+ * Runs one parsed program over many input sets at once: every instance
+ * (lane) has its own variables, loops, calls and input, and the lanes that
+ * are on the same statement execute it together.
+ * Variables are stored structure-of-arrays, a column of lanes per slot, so
+ * an expression is evaluated for the whole group one operator at a time
+ * over contiguous lanes: + - * and the IF comparisons use AVX2 when the
+ * CPU has it (8 lanes per instruction), / MOD and ** are computed lane by
+ * lane. Arrays are kept per lane.
+ * Lanes diverge at IF, FOR, NEXT and RETURN. The lanes with the lowest
+ * plan index run next, so lanes that took a branch wait for the others at
+ * the statements after it and run together again from there; a group of
+ * lanes that are not contiguous is gathered through its lane indices.
+ * Every instance prints and fails exactly as a run of Program::execute()
+ * with its input would. Limits apply per instance (the wall time to the
+ * whole run); breakpoints, snapshots and traces are not used.
+ * The lanes are run in blocks of lanesPerBlock.
+*/
+class Lockstep
+{
+public:
+    explicit Lockstep(Program* program);
+    bool run(const std::vector<QStringList>& inputs, std::vector<LockstepResult>& results);
+    static bool hasAvx2();
+    static void setAvx2(bool enabled);//for benchmarks, ignored without CPU support
+
+private:
+    static constexpr int lanesPerBlock = 1024;
+    Program* program;
+    int width = 0;//lanes of the current block
+/* Variables, slot * width + lane.*/
+    enum VariableState : unsigned char { undefinedState, valueState, arrayState };
+    std::vector<int> values;
+    std::vector<unsigned char> states;
+    std::vector<std::vector<int>> arrays;
+/* Per lane state, see Program for the loop and call frames.*/
+    struct Lane
+    {
+        int index;//plan index of the next statement
+        qint64 steps;
+        qint64 outputLines;
+        int inputLine;
+        int loopDepth;
+        std::vector<Program::CallFrame> calls;
+        const QStringList* input;
+        LockstepResult* result;
+    };
+    std::vector<Lane> lanes;
+    std::vector<Program::LoopFrame> loops;//depth * width + lane
+    Program::LoopFrame& frame(int lane, int depth) { return loops[(size_t)depth * width + lane]; }
+    std::vector<Status> statuses;//the error of a lane in the current statement
+/* Lanes still running and the group executing the current statement,
+ * both in increasing lane order.*/
+    std::vector<int> active;
+    std::vector<int> group;
+    bool contiguous = false;//group is the lanes group[0] ... group[0] + size - 1
+/* Operand stack of the evaluation, width ints per entry, and the values
+ * on the stack of the tape with the operand stack top before each.*/
+    std::vector<int> scratch;
+    int scratchTop = 0;
+    int* push();
+    struct Operand
+    {
+        const int* values;
+        int top;
+    };
+    std::vector<Operand> operands;
+
+    void runBlock(const std::vector<QStringList>& inputs, std::vector<LockstepResult>& results, int first, int count);
+    void formGroup();
+    void dropFinished();
+    void execute(Statement* stmt, int* next);
+    void advance(int lane, Statement* stmt, int retpc);
+    const int* evaluate(const Expression* exp, int first, int last);
+    const int* evaluate(const Expression* exp) { return evaluate(exp, 0, exp->tape.size()); }
+    const int* readVariable(const ExpressionNode* node);
+    void readElement(const ExpressionNode* node, const int* index, int* result);
+    void operate(ExpOperation opt, const int* left, const int* right, int* result);
+    int* element(int lane, const ExpressionNode* node, int index);
+    void setVariable(int lane, int slot, int value);
+    void input(int lane, int slot);
+    void output(int lane, int value);
+    bool enterLoop(int lane, int forLine, int slot, int limit, int step);
+    bool nextIteration(int lane, int forLine);
+    int loopBase(int lane) const;
+    void fail(int lane, ErrorCode code, const QString& subject = QString(), long long number = 0);
+    void failGroup(ErrorCode code, const QString& subject = QString(), long long number = 0);
+    void finish(int lane, const QString& error = QString());
+};
+
+#endif // LOCKSTEP_H
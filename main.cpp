@@ -1,9 +1,21 @@
 #include "mainwindow.h"
+#include "headless.h"
+#include "server.h"
 
 #include <QApplication>
+#include <QCoreApplication>
 
 int main(int argc, char *argv[])
 {
+    QString mode = argc > 1 ? QString(argv[1]) : QString();
+    if (mode == "--headless" || mode == "--server" || mode == "--client") {
+        QCoreApplication a(argc, argv);
+        QStringList args;
+        for (int i = 1; i < argc; i++) args << QString::fromLocal8Bit(argv[i]);
+        if (mode == "--server") return runServer(args);
+        if (mode == "--client") return runClient(args);
+        return runHeadless(args);
+    }
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
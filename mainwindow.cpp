@@ -3,7 +3,15 @@
 #include "program.h"
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QProgressDialog>
+#include <QTimer>
 #include "config.h"
+#include "metrics.h"
+#include "lexicon.h"
+
+static const int loadPollMs = 50;//progress updates of a LOAD
+static const int loadDialogDelayMs = 500;//a LOAD that takes longer shows its progress
+static const int loadProgressSteps = 1000;
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -14,7 +22,8 @@ MainWindow::MainWindow(QWidget *parent)
 
     
     program = new Program(this);
-    program_temp = new Program(this,true);
+    loadTimer = new QTimer(this);
+    connect(loadTimer, &QTimer::timeout, this, &MainWindow::pollLoad);
     
     connect(ui->btnDebugMode, &QPushButton::clicked, this, &MainWindow::setUIForDebugMode);
 
@@ -107,6 +116,14 @@ void MainWindow::setUIExitDebugMode(){
 * 4. QUIT: exit the program
 * 5. LIST: do nothing
 * 6. <number> <statement>: update the statement of the program
+* 7. STATS [RESET]: show (or reset) the runtime metrics counters
+* 8. CFG: show the control flow graph of the last run
+* 9. SNAPSHOT <file>: save pc, variables and breakpoints of the program
+* 10. RESTORE <file>: restore a snapshot and continue the run from its pc
+* 11. TRACE [<file> [<n>]]: write a trace of the following runs to file,
+*     sampling one statement in n; without a file, stop tracing
+* 12. COVERAGE [<file>]: write the lines the following runs execute to
+*     file (lcov if it ends in .info); without a file, stop recording
 
 */
 bool MainWindow::parseCommand(const QString& s)
@@ -120,29 +137,25 @@ bool MainWindow::parseCommand(const QString& s)
     if(firstSpaceIndex != -1) argv1 = trimmed.mid(firstSpaceIndex + 1).trimmed();
     else argv1 = "";
     
-    if (QString::compare(argv0, "LOAD") == 0) {
+    switch (keywordOf(argv0)) {
+    case loadKw:
         // Handle LOAD command
-        if(askAndLoadProgram()) return true;
-    } else if (QString::compare(argv0, "RUN") == 0) {
+        return askAndLoadProgram();
+    case runKw:
         // Handle RUN command
-        if(program->execute()) return true;
-    } else if (QString::compare(argv0, "CLEAR") == 0) {
+        return program->execute();
+    case clearKw:
         // Handle CLEAR command
         program->clear();
         return true;
-    } else if (QString::compare(argv0, "QUIT") == 0) {
+    case quitKw:
         // Handle QUIT command
         exit(0);
         return true;
-    } else if (QString::compare(argv0, "LIST") == 0) {
+    case listKw:
         // Handle LIST command(Abandoned)
         return true;
-    } else if (argv0.toInt()) {
-        // Handle <number> <statement> command
-        if(program->inDebugMode()) return false;
-        if(program->updateStatement(argv0.toInt(), argv1)) 
-            return true;
-    } else if (QString::compare(argv0, "ADD") == 0) {
+    case addKw: {
         // Handle ADD command
         if(!program->inDebugMode()) return false;
         bool ok;
@@ -153,7 +166,8 @@ bool MainWindow::parseCommand(const QString& s)
         }
         program->setBreakpoint(line);
         return true;
-    } else if (QString::compare(argv0, "DELETE") == 0) {
+    }
+    case deleteKw: {
         if(!program->inDebugMode()) return false;
         bool ok;
         int line = argv1.toInt(&ok);
@@ -163,24 +177,54 @@ bool MainWindow::parseCommand(const QString& s)
         }
         program->removeBreakpoint(line);
         return true;
-    } else if(QString::compare(argv0, "PRINT") == 0){
-        if(program->inDebugMode()) return false;
-        program_temp->executeStatement(s);
-        return true;
     }
-    else if(QString::compare(argv0, "LET") == 0){
+    case printKw:
+    case letKw:
+    case inputKw:
+    case dimKw:
+        //immediate mode, with the variables of the program
         if(program->inDebugMode()) return false;
-        program_temp->executeStatement(s);
+        program->executeStatement(s);
         return true;
-    }
-    else if(QString::compare(argv0, "INPUT") == 0){
-        //handle the command in programtemp
-        if(program->inDebugMode()) return false;
-        program_temp->executeStatement(s);
+    case statsKw:
+        if(keywordOf(argv1) == resetKw) metrics.reset();
+        else ui->textBrowser->append(metrics.toText());
+        return true;
+    case cfgKw:
+        ui->textBrowser->append(program->showControlFlowGraph());
+        return true;
+    case snapshotKw:
+        if(argv1.isEmpty()) return false;
+        return program->saveSnapshot(argv1);
+    case restoreKw:
+        if(argv1.isEmpty() || !program->loadSnapshot(argv1)) return false;
+        return program->executeFrom(program->getPc());
+    case traceKw: {
+        QStringList args = argv1.split(' ', Qt::SkipEmptyParts);
+        if(args.size() > 2) return false;
+        int sampleEvery = 1;
+        if(args.size() == 2){
+            bool ok;
+            sampleEvery = args[1].toInt(&ok);
+            if(!ok || sampleEvery < 1) return false;
+        }
+        program->setTrace(args.isEmpty() ? QString() : args[0], sampleEvery);
         return true;
     }
-    else if(QString::compare(argv0, "HELP") == 0){
+    case coverageKw:
+        program->setCoverage(argv1);
+        return true;
+    case helpKw:
         QMessageBox::information(this, "Help", "Help information");
+        return false;
+    default:
+        break;
+    }
+    if (argv0.toInt()) {
+        // Handle <number> <statement> command
+        if(program->inDebugMode()) return false;
+        if(program->updateStatement(argv0.toInt(), argv1)) 
+            return true;
     }
     // Default:Handle invalid command
     return false;
@@ -189,7 +233,7 @@ bool MainWindow::parseCommand(const QString& s)
 bool MainWindow::askAndLoadProgram(){
     if(debugMode) {
         loadProgram(testFilename);
-        executeProgram();
+        runWhenLoaded = true;
         return true;
     }
     QString filename = QFileDialog::getOpenFileName(this, tr("Open Program"), "", tr("Program Files (*.txt *.bas)"));
@@ -199,25 +243,56 @@ bool MainWindow::askAndLoadProgram(){
     return false;
 }
 
+/* MainWindow::loadProgram
+* Start loading filename in the background, instead of a load in progress.
+* The window stays usable; a load that takes a while shows its progress in
+* a dialog that can cancel it. The program is replaced once the whole file
+* is read (see pollLoad), and kept if it can not be.
+*/
 bool MainWindow::loadProgram(const QString& filename){
-    QFile file(filename);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qDebug()<<"Failed to open file: "<<filename;
-        return false;
+    loader.reset();
+    delete loadProgress;
+    runWhenLoaded = false;
+    loader = std::make_unique<ProgramLoader>(filename);
+    loader->start();
+    loadProgress = new QProgressDialog("Loading " + filename, "Cancel", 0, loadProgressSteps, this);
+    loadProgress->setMinimumDuration(loadDialogDelayMs);
+    loadProgress->setAutoClose(false);
+    loadProgress->setAutoReset(false);
+    connect(loadProgress, &QProgressDialog::canceled, this, [this]() {
+        if(loader) loader->cancel();
+    });
+    loadTimer->start(loadPollMs);
+    return true;
+}
+
+/* MainWindow::pollLoad
+* Show the progress of the load in progress, and put the program it read
+* in place of the current one when it is done.
+*/
+void MainWindow::pollLoad(){
+    if(!loader) return;
+    qint64 total = loader->getTotalBytes();
+    loadProgress->setLabelText(QString("Loading: %1 of %2 KB, %3 lines")
+                                   .arg(loader->getBytesRead() / 1024).arg(total / 1024).arg(loader->getLinesRead()));
+    loadProgress->setValue(total > 0 ? int(loader->getBytesRead() * loadProgressSteps / total) : 0);
+    if(!loader->isFinished()) return;
+    loadTimer->stop();
+    loadProgress->deleteLater();
+    loadProgress = nullptr;
+    std::unique_ptr<ProgramLoader> done = std::move(loader);
+    if(done->isCancelled()) return;
+    if(!done->getError().isEmpty()) {
+        QMessageBox::information(this, "错误", "选中文件无法解析\n" + done->getError());
+        return;
     }
-    QTextStream in(&file);
-    QString line;
     program->clear();
     updateOutput(QString());
-    while (!in.atEnd()) {
-        line = in.readLine();
-        if(!parseCommand(line)){
-            QMessageBox::information(this, "错误", "选中文件无法解析");
-            program->clear();
-            return false;
-        }
+    program->setVersion(done->getVersion());
+    if(runWhenLoaded) {
+        runWhenLoaded = false;
+        executeProgram();
     }
-    return true;
 }
 
 bool MainWindow::executeProgram(){
@@ -2,10 +2,14 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <memory>
 #include "program.h"
+#include "loader.h"
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
+class QProgressDialog;
+class QTimer;
 
 class MainWindow : public QMainWindow
 {
@@ -17,11 +21,16 @@ public:
 
 private slots:
     void on_cmdLineEdit_editingFinished();
+    void pollLoad();
 
 private:
     Ui::MainWindow *ui;
     Program *program;
-    Program *program_temp;
+/* LOAD in progress: the program is replaced when it is done.*/
+    std::unique_ptr<ProgramLoader> loader;
+    QProgressDialog *loadProgress = nullptr;
+    QTimer *loadTimer;
+    bool runWhenLoaded = false;
 
     void setUIForDebugMode();
     void setUIExitDebugMode();
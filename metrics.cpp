@@ -0,0 +1,88 @@
+#include "metrics.h"
+
+thread_local Metrics metrics;
+
+/* Metrics::reset
+* Set every counter back to zero.
+*/
+void Metrics::reset()
+{
+    *this = Metrics();
+}
+
+/* Metrics::add
+* Add the counters of other to these.
+*/
+void Metrics::add(const Metrics& other)
+{
+    statementsExecuted += other.statementsExecuted;
+    nodesEvaluated += other.nodesEvaluated;
+    memoHits += other.memoHits;
+    sharedHits += other.sharedHits;
+    variableReads += other.variableReads;
+    variableWrites += other.variableWrites;
+    boundsChecks += other.boundsChecks;
+    tokenizations += other.tokenizations;
+    statementParses += other.statementParses;
+    expressionParses += other.expressionParses;
+    parserAllocations += other.parserAllocations;
+    gotoJumps += other.gotoJumps;
+    ifJumps += other.ifJumps;
+    gosubCalls += other.gosubCalls;
+    inputWaits += other.inputWaits;
+    inputWaitNs += other.inputWaitNs;
+}
+
+/* Metrics::toText
+* Human readable report, one counter per line.
+*/
+QString Metrics::toText() const
+{
+    if(!METRICS_ENABLED) return "Metrics are disabled in this build.\n";
+    QString res;
+    res += "statements executed: " + QString::number(statementsExecuted) + "\n";
+    res += "expression nodes evaluated: " + QString::number(nodesEvaluated) + "\n";
+    res += "memoized subexpressions reused: " + QString::number(memoHits) + "\n";
+    res += "common subexpressions reused: " + QString::number(sharedHits) + "\n";
+    res += "variable reads: " + QString::number(variableReads) + "\n";
+    res += "variable writes: " + QString::number(variableWrites) + "\n";
+    res += "array bounds checks: " + QString::number(boundsChecks) + "\n";
+    res += "tokenizations: " + QString::number(tokenizations) + "\n";
+    res += "statement parses: " + QString::number(statementParses) + "\n";
+    res += "expression parses: " + QString::number(expressionParses) + "\n";
+    res += "parser heap allocations: " + QString::number(parserAllocations) + "\n";
+    res += "GOTO jumps: " + QString::number(gotoJumps) + "\n";
+    res += "IF jumps: " + QString::number(ifJumps) + "\n";
+    res += "GOSUB calls: " + QString::number(gosubCalls) + "\n";
+    res += "INPUT waits: " + QString::number(inputWaits) + "\n";
+    res += "INPUT wait time (ms): " + QString::number(inputWaitNs / 1000000.0, 'f', 3) + "\n";
+    return res;
+}
+
+/* Metrics::toJson
+* The same counters as a flat JSON object.
+*/
+QString Metrics::toJson() const
+{
+    if(!METRICS_ENABLED) return "{\"enabled\": false}\n";
+    QString res = "{\n";
+    res += "  \"enabled\": true,\n";
+    res += "  \"statementsExecuted\": " + QString::number(statementsExecuted) + ",\n";
+    res += "  \"nodesEvaluated\": " + QString::number(nodesEvaluated) + ",\n";
+    res += "  \"memoHits\": " + QString::number(memoHits) + ",\n";
+    res += "  \"sharedHits\": " + QString::number(sharedHits) + ",\n";
+    res += "  \"variableReads\": " + QString::number(variableReads) + ",\n";
+    res += "  \"variableWrites\": " + QString::number(variableWrites) + ",\n";
+    res += "  \"boundsChecks\": " + QString::number(boundsChecks) + ",\n";
+    res += "  \"tokenizations\": " + QString::number(tokenizations) + ",\n";
+    res += "  \"statementParses\": " + QString::number(statementParses) + ",\n";
+    res += "  \"expressionParses\": " + QString::number(expressionParses) + ",\n";
+    res += "  \"parserAllocations\": " + QString::number(parserAllocations) + ",\n";
+    res += "  \"gotoJumps\": " + QString::number(gotoJumps) + ",\n";
+    res += "  \"ifJumps\": " + QString::number(ifJumps) + ",\n";
+    res += "  \"gosubCalls\": " + QString::number(gosubCalls) + ",\n";
+    res += "  \"inputWaits\": " + QString::number(inputWaits) + ",\n";
+    res += "  \"inputWaitNs\": " + QString::number(inputWaitNs) + "\n";
+    res += "}\n";
+    return res;
+}
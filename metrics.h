@@ -0,0 +1,52 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+
+/*
+ * Metrics
+ * Cheap runtime counters of the interpreter, printed by the STATS command
+ * and dumped as JSON by the headless runner.
+ * The counters are only touched through the METRIC_* macros below, which
+ * expand to nothing unless QBASIC_METRICS is defined
+ * (cmake option QBASIC_ENABLE_METRICS).
+*/
+struct Metrics
+{
+    quint64 statementsExecuted = 0;
+    quint64 nodesEvaluated = 0;
+    quint64 memoHits = 0;
+    quint64 sharedHits = 0;//memo hits on a value another occurrence of the subexpression computed
+    quint64 variableReads = 0;
+    quint64 variableWrites = 0;
+    quint64 boundsChecks = 0;
+    quint64 tokenizations = 0;
+    quint64 statementParses = 0;
+    quint64 expressionParses = 0;
+    quint64 parserAllocations = 0;
+    quint64 gotoJumps = 0;
+    quint64 ifJumps = 0;
+    quint64 gosubCalls = 0;
+    quint64 inputWaits = 0;
+    qint64 inputWaitNs = 0;
+
+    void reset();
+    void add(const Metrics& other);
+    QString toText() const;
+    QString toJson() const;
+};
+
+//Each thread counts on its own copy; parse workers add theirs to the
+//copy of the thread that started them (Program::parseInParallel).
+extern thread_local Metrics metrics;
+
+#ifdef QBASIC_METRICS
+#define METRICS_ENABLED true
+#define METRIC_ADD(counter, n) (metrics.counter += (n))
+#else
+#define METRICS_ENABLED false
+#define METRIC_ADD(counter, n) ((void)0)
+#endif
+#define METRIC_INC(counter) METRIC_ADD(counter, 1)
+
+#endif // METRICS_H
@@ -0,0 +1,215 @@
+#include "profiler.h"
+#include <algorithm>
+#include <vector>
+#if defined(__linux__)
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+Profiler profiler;
+std::atomic<int> profiledLine{0};
+std::atomic<int> profiledOperator{0};
+
+namespace {
+
+/*
+ * Samples by (line, operator), in an open addressing table the signal
+ * handler fills without allocating. A slot is claimed with a compare and
+ * swap of its key, so a sample landing on another thread is safe too.
+*/
+struct SampleEntry
+{
+    std::atomic<quint64> key;//(line << 8 | operator) + 1, 0 if free
+    std::atomic<quint64> count;
+};
+
+const int sampleTableBits = 14;
+const int sampleTableSize = 1 << sampleTableBits;
+const int maxProbes = 64;
+SampleEntry sampleTable[sampleTableSize];
+std::atomic<quint64> lostSamples{0};//the table was full around their slot
+int samplingHz = 0;
+
+void countSample(int line, int op)
+{
+    quint64 key = ((quint64)(unsigned)line << 8 | (unsigned)op) + 1;
+    unsigned slot = unsigned((key * 0x9E3779B97F4A7C15ull) >> (64 - sampleTableBits));
+    for(int probe = 0; probe < maxProbes; probe++){
+        SampleEntry& entry = sampleTable[(slot + probe) & (sampleTableSize - 1)];
+        quint64 found = entry.key.load(std::memory_order_relaxed);
+        if(found == 0 && entry.key.compare_exchange_strong(found, key)) found = key;
+        if(found == key){
+            entry.count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    lostSamples.fetch_add(1, std::memory_order_relaxed);
+}
+
+#if defined(__linux__)
+void onProfileSignal(int)
+{
+    countSample(profiledLine.load(std::memory_order_relaxed), profiledOperator.load(std::memory_order_relaxed));
+}
+#endif
+
+struct Sample
+{
+    int line;
+    int op;
+    quint64 count;
+};
+
+std::vector<Sample> collectSamples()
+{
+    std::vector<Sample> samples;
+    for(const SampleEntry& entry : sampleTable){
+        quint64 key = entry.key.load(std::memory_order_relaxed);
+        if(key == 0) continue;
+        samples.push_back(Sample{int((key - 1) >> 8), int((key - 1) & 0xff), entry.count.load(std::memory_order_relaxed)});
+    }
+    return samples;
+}
+
+QString operatorName(int op)
+{
+    static const char* names[profileOperatorCount] = {"(none)", "+", "-", "*", "/", "MOD", "**", "a()"};
+    return op >= 0 && op < profileOperatorCount ? names[op] : "?";
+}
+
+QString lineLabel(int line, const std::map<int, QString>& labels)
+{
+    if(line == 0) return "(outside the program)";
+    auto it = labels.find(line);
+    return QString::number(line) + " " + (it != labels.end() ? it->second : QString());
+}
+
+QString percent(quint64 part, quint64 total)
+{
+    return QString::number(total ? 100.0 * part / total : 0.0, 'f', 1) + "%";
+}
+
+}
+
+/* Profiler::isSupported
+* True if this platform has the SIGPROF timer.
+*/
+bool Profiler::isSupported()
+{
+#if defined(__linux__)
+    return PROFILER_ENABLED;
+#else
+    return false;
+#endif
+}
+
+/* Profiler::start
+* Start sampling hz times per second of CPU time, adding to the samples
+* taken so far. Return false if profiling is not supported.
+*/
+bool Profiler::start(int hz)
+{
+    if(!isSupported() || hz <= 0) return false;
+#if defined(__linux__)
+    struct sigaction action = {};
+    action.sa_handler = onProfileSignal;
+    action.sa_flags = SA_RESTART;//INPUT reads are not interrupted
+    sigemptyset(&action.sa_mask);
+    if(sigaction(SIGPROF, &action, nullptr) != 0) return false;
+    struct itimerval timer = {};
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = std::max(1, 1000000 / hz);
+    timer.it_value = timer.it_interval;
+    if(setitimer(ITIMER_PROF, &timer, nullptr) != 0) return false;
+    samplingHz = hz;
+    running = true;
+#endif
+    return true;
+}
+
+/* Profiler::stop
+* Stop the timer. A signal still pending is ignored.
+*/
+void Profiler::stop()
+{
+    if(!running) return;
+#if defined(__linux__)
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    signal(SIGPROF, SIG_IGN);
+#endif
+    running = false;
+}
+
+void Profiler::reset()
+{
+    for(SampleEntry& entry : sampleTable){
+        entry.key.store(0, std::memory_order_relaxed);
+        entry.count.store(0, std::memory_order_relaxed);
+    }
+    lostSamples.store(0, std::memory_order_relaxed);
+}
+
+quint64 Profiler::getSamples() const
+{
+    quint64 total = lostSamples.load(std::memory_order_relaxed);
+    for(const Sample& sample : collectSamples()) total += sample.count;
+    return total;
+}
+
+/* Profiler::toText
+* The samples by line and by operator, most sampled first.
+*/
+QString Profiler::toText(const std::map<int, QString>& labels) const
+{
+    if(!isSupported()) return "The profiler is not available in this build.\n";
+    std::vector<Sample> samples = collectSamples();
+    std::map<int, quint64> byLine;
+    quint64 byOperator[profileOperatorCount] = {};
+    quint64 total = 0;
+    for(const Sample& sample : samples){
+        byLine[sample.line] += sample.count;
+        if(sample.op < profileOperatorCount) byOperator[sample.op] += sample.count;
+        total += sample.count;
+    }
+    QString res = QString("%1 samples at %2 Hz (about %3 ms of CPU time), %4 lost\n")
+            .arg(total).arg(samplingHz).arg(samplingHz ? total * 1000 / samplingHz : 0)
+            .arg(lostSamples.load(std::memory_order_relaxed));
+
+    std::vector<std::pair<quint64, int>> lines;
+    for(auto& [line, count] : byLine) lines.push_back({count, line});
+    std::sort(lines.begin(), lines.end(), [](auto& a, auto& b) { return a.first > b.first; });
+    res += "\nby line:\n";
+    for(auto& [count, line] : lines)
+        res += QString("%1 %2  %3\n").arg(count, 10).arg(percent(count, total), 6).arg(lineLabel(line, labels));
+
+    std::vector<std::pair<quint64, int>> operators;
+    for(int op = 0; op < profileOperatorCount; op++)
+        if(byOperator[op]) operators.push_back({byOperator[op], op});
+    std::sort(operators.begin(), operators.end(), [](auto& a, auto& b) { return a.first > b.first; });
+    res += "\nby operator:\n";
+    for(auto& [count, op] : operators)
+        res += QString("%1 %2  %3\n").arg(count, 10).arg(percent(count, total), 6).arg(operatorName(op));
+    return res;
+}
+
+/* Profiler::toFolded
+* One "QBasic;<line>;<operator> <samples>" line per sampled pair, the
+* collapsed stack format of flamegraph.pl and speedscope.
+*/
+QString Profiler::toFolded(const std::map<int, QString>& labels) const
+{
+    std::vector<Sample> samples = collectSamples();
+    std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) {
+        return a.line != b.line ? a.line < b.line : a.op < b.op;
+    });
+    QString res;
+    for(const Sample& sample : samples){
+        QString frame = lineLabel(sample.line, labels);
+        frame.replace(";", ",");//the frame separator
+        res += "QBasic;" + frame;
+        if(sample.op != 0) res += ";" + operatorName(sample.op);
+        res += " " + QString::number(sample.count) + "\n";
+    }
+    return res;
+}
@@ -0,0 +1,74 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QString>
+#include <atomic>
+#include <map>
+#include "tokenizer.h"
+
+/*
+ * Profiler
+ * Statistical profiler of the interpreter. A SIGPROF timer (setitimer with
+ * ITIMER_PROF, so only CPU time is sampled) interrupts the run and counts
+ * a sample for the line being executed and the operator being evaluated,
+ * which the interpreter publishes in two atomics through the PROFILE_*
+ * macros below: one relaxed store per statement and two per operation.
+ * The signal handler only increments a preallocated table.
+ * The macros expand to nothing unless QBASIC_PROFILER is defined
+ * (cmake option QBASIC_ENABLE_PROFILER); the timer needs Linux.
+*/
+class Profiler
+{
+public:
+    static bool isSupported();
+    bool start(int hz);
+    void stop();
+    void reset();
+    quint64 getSamples() const;
+/* Reports, labels: the statement of every line.*/
+    QString toText(const std::map<int, QString>& labels) const;
+    QString toFolded(const std::map<int, QString>& labels) const;//flamegraph.pl input
+private:
+    bool running = false;
+};
+
+extern Profiler profiler;
+
+//Published state: the line being executed (0: none) and the operator being
+//evaluated, see profileOperatorOf.
+extern std::atomic<int> profiledLine;
+extern std::atomic<int> profiledOperator;
+
+//Operator codes: 0 none, 1 + ExpOperation, elementOperator for a(i).
+inline int profileOperatorOf(ExpOperation opt) { return 1 + int(opt); }
+static const int elementOperator = 1 + int(ExpOperation::power) + 1;
+static const int profileOperatorCount = elementOperator + 1;
+
+/*
+ * ProfiledOperator
+ * Publishes an operator while its operands and itself are evaluated:
+ * nested operators take over and give it back when they return.
+*/
+class ProfiledOperator
+{
+public:
+    explicit ProfiledOperator(int op) : saved(profiledOperator.load(std::memory_order_relaxed))
+    {
+        profiledOperator.store(op, std::memory_order_relaxed);
+    }
+    ~ProfiledOperator() { profiledOperator.store(saved, std::memory_order_relaxed); }
+private:
+    int saved;
+};
+
+#ifdef QBASIC_PROFILER
+#define PROFILER_ENABLED true
+#define PROFILE_LINE(line) profiledLine.store((line), std::memory_order_relaxed)
+#define PROFILE_OPERATOR(op) ProfiledOperator profiledOperatorScope(op)
+#else
+#define PROFILER_ENABLED false
+#define PROFILE_LINE(line) ((void)0)
+#define PROFILE_OPERATOR(op) ((void)0)
+#endif
+
+#endif // PROFILER_H
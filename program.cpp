@@ -2,10 +2,43 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "statement.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "scanner.h"
+#include "lexicon.h"
+#include "lockstep.h"
 #include <QFile>
 #include <QTextStream>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QMessageBox>
+#include <QDataStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+//Number of steps between two checks of the wall time limit.
+static const qint64 limitCheckInterval = 4096;
+
+//Programs with fewer statements are parsed on the calling thread only.
+static const int parallelParseThreshold = 2048;
+//Statements a parse worker takes at a time.
+static const int parseChunkSize = 256;
+//Syntax errors listed in one report.
+static const int maxReportedErrors = 20;
+
+//Elements of an array listed by showVariables.
+static const int maxShownElements = 16;
+//Largest call depth setLimits accepts.
+static const int maxCallStack = 1 << 20;
+//Immediate commands kept compiled.
+static const int maxImmediateCommands = 256;
+
+//Node pool of the parse worker running on this thread, see parseInParallel.
+static thread_local NodePool* workerNodePool = nullptr;
 
 /*Program::Program
 * Initialize the program.parent is the pointer to mainwindow.
@@ -15,6 +48,7 @@ Program::Program(MainWindow *parent, bool background)
     this->parent = parent;
     this->background = background;
     pc = 0;
+    calls.resize(limits.maxCallDepth);
 }
 
 /* Program::init
@@ -23,8 +57,11 @@ Program::Program(MainWindow *parent, bool background)
 * - set pc to the first line of the program.
 */
 void Program::init(){
-    pc = statements.begin()->first;
-    variables.clear();
+    syncStatements();
+    pc = statements.empty() ? 0 : statements.begin()->getLine();
+    undefineVariables();
+    loopDepth = 0;
+    callDepth = 0;
     ended = false;
 }
 
@@ -36,29 +73,19 @@ void Program::init(){
 *   If the line number is already used, the old statement will be covered.
 *   If the line number is not used, a new statement will be created.
 *   If s is empty, the statement will be deleted and the line number will be freed.
+*   The edit makes a new version of the program; a running program goes on
+*   with the version it started with.
 */
 bool Program::updateStatement(int line, const QString& s)
 {
     if(line <= 0) return false;
     if(s.isEmpty()) {
-        delete statements[line];
-        statements.erase(line);
+        currentVersion = currentVersion.without(line);
     }
     else{
         try{
-            QString trimmed_s;
-            for(int i = 0; i < s.size(); i++){
-                if(s[i] != ' '||(i>1&&s[i-1] != ' '))
-                    trimmed_s += s[i];
-            }
-
-            if(statements.find(line) != statements.end()) {
-                statements[line]->setStatement(trimmed_s);
-            }
-            else{
-                statements[line] = new Statement(this);
-                statements[line]->setStatement(trimmed_s);
-            }
+            QString trimmed_s = Scanner::collapseSpaces(s);
+            currentVersion = currentVersion.with(line, trimmed_s);
         }
         catch(std::exception& e){
             //qDebug() << e.what();
@@ -71,95 +98,326 @@ bool Program::updateStatement(int line, const QString& s)
     return true;
 }
 
-void Program::executeStatement(const QString& s){
+/* Program::executeStatement
+* Execute s in immediate mode, with the variables of the program.
+* Return false if it failed.
+*/
+bool Program::executeStatement(const QString& s){
+    Status status;
     try{
-        Statement * st = new Statement(this);
-        st->setStatement(s);
-        st->parse();
-        st->execute();
-        delete st;
+        Statement* st = immediateStatement(Scanner::collapseSpaces(s), status);
+        expressionBytes = 0;
+        if(status.ok()) addExpressionMemory(st, status);
+        outputLines = 0;
+        if(status.ok()) st->execute(status);
     }
     catch(std::exception& e){
-        QMessageBox::critical(parent, "Error", QString(e.what()));
+        //only allocation failures are thrown
+        reportError("Error", QString(e.what()));
+        return false;
     }
+    if(status.ok()) return true;
+    reportError("Error", status);
+    return false;
 }
+/* Program::immediateStatement
+* The compiled statement of the immediate command s: the cached one, or s
+* parsed and cached, dropping the least recently used command when the
+* cache is full. A command with a syntax error is not kept.
+*/
+Statement* Program::immediateStatement(const QString& s, Status& status)
+{
+    auto it = immediateCommands.find(s);
+    if(it != immediateCommands.end()){
+        it->second.lastUse = ++immediateClock;
+        return it->second.statement.get();
+    }
+    auto statement = std::make_unique<Statement>(this);
+    statement->setStatement(s);
+    statement->parse(status);
+    if(!status.ok()) return nullptr;
+    if((int)immediateCommands.size() >= maxImmediateCommands){
+        auto oldest = std::min_element(immediateCommands.begin(), immediateCommands.end(),
+            [](const auto& a, const auto& b){ return a.second.lastUse < b.second.lastUse; });
+        immediateCommands.erase(oldest);
+    }
+    Statement* result = statement.get();
+    immediateCommands[s] = ImmediateCommand{std::move(statement), ++immediateClock};
+    return result;
+}
+
 /* Program::execute
 * Execute the program.
 */
 bool Program::execute()
 {
-    //TODO
+    if(running){
+        reportError("Error", "The program is already running");
+        return false;
+    }
     init();
+    return executeFrom(pc);
+}
+
+/* Program::executeFrom
+* Execute the program starting at line, keeping the current variables.
+* Used to resume a run restored from a snapshot.
+*/
+bool Program::executeFrom(int line)
+{
+    if(running){
+        reportError("Error", "The program is already running");
+        return false;
+    }
+    syncStatements();
+    ended = false;
+    if(statements.empty()) return true;
+    if(statements.find(line) == nullptr){
+        reportError("Error", QString("Line %1 does not exist").arg(line));
+        return false;
+    }
+    startLimits();
     if(!parseAllStatements()) return false;
     else updateTreeDisplay();
+    buildExecutionPlan(line);
+    int index = statements.find(line)->planIndex;
+    if(tracer.isEnabled()){
+        QVector<int> planLines;
+        for(const Statement* stmt : plan) planLines.append(stmt->line);
+        tracer.beginRun(planLines);
+    }
+    if(coverage.isEnabled()) coverage.beginRun(plan.size());
+    running = true;
+    bool ok = runPlan(index);
+    running = false;
+    PROFILE_LINE(0);
+    if(coverage.isEnabled() && !saveCoverage()) ok = false;
+    if(clearPending){
+        clearPending = false;
+        clearState();
+        updateTreeDisplay();
+    }
+    if(!tracer.isEnabled()) return ok;
+    tracer.endRun();
+    if(!tracer.save(traceFile)){
+        reportError("Trace Error", "Failed to write trace file: " + traceFile);
+        return false;
+    }
+    return ok;
+}
+
+/* Program::executeLockstep
+* Run the program from its first line once for every input set of inputs,
+* all at once (see Lockstep). results gets what each run printed and the
+* errors it reported, as execute() with that input would. A syntax error
+* is reported to every run. Return false if a run failed.
+*/
+bool Program::executeLockstep(const std::vector<QStringList>& inputs, std::vector<LockstepResult>& results)
+{
+    results.assign(inputs.size(), LockstepResult());
+    if(running){
+        reportError("Error", "The program is already running");
+        return false;
+    }
+    init();
+    if(statements.empty()) return true;
+    startLimits();
+    QString errors;
+    QTextStream errorText(&errors);
+    QTextStream* savedErrors = errorStream;
+    errorStream = &errorText;
+    bool ok = parseAllStatements();
+    errorStream = savedErrors;
+    if(!ok){
+        errorText.flush();
+        for(LockstepResult& result : results){
+            result.errors = errors;
+            result.ok = false;
+        }
+        return false;
+    }
+    updateTreeDisplay();
+    buildExecutionPlan(pc);
+    if(coverage.isEnabled()) coverage.beginRun(plan.size());
+    running = true;
+    Lockstep lockstep(this);
+    ok = lockstep.run(inputs, results);
+    running = false;
+    if(coverage.isEnabled() && !saveCoverage()) ok = false;
+    if(clearPending){
+        clearPending = false;
+        clearState();
+        updateTreeDisplay();
+    }
+    return ok;
+}
+
+/* Program::runPlan
+* Execute the plan from index until the program ends or fails.
+*/
+bool Program::runPlan(int index)
+{
+    Status status;
     try{
-        while(pc != -1){
+        while(index < plan.size()){
+            Statement* stmt = plan[index];
+            pc = stmt->line;
+            PROFILE_LINE(pc);
             //qDebug() << "pc: " << pc<<"DEBUG MODE: "<<debug;
             if(ended) return true;
-            if(statements.find(pc) == statements.end())
-                return false;
+            if(limitCountdown == 0){
+                checkLimits(status);
+                if(!status.ok()) break;
+            }
+            limitCountdown--;
+            if(pc == snapshotLine){
+                //checkpoint: save the state before executing the line and stop
+                snapshotLine = 0;
+                return saveSnapshot(snapshotFile);
+            }
             if(debug&&isBreakpoint(pc)){//in debug mode
                 //TODO: handle the breakpoint function.
                 //qDebug()<<"breakpoint reached";
                 breakpoint_blocked = true;
                 parent->updateVariables(showVariables());
+                if(tracer.isEnabled()) tracer.closeLine();
 
                 blockTillFalse(breakpoint_blocked);
                 if(!debug||ended) return true;
                 //If the block is ended by "EXIT" command, end the execution.
             }
-            int retpc = statements[pc]->execute();
+            METRIC_INC(statementsExecuted);
+            if(coverage.isEnabled()) coverage.hit(index);
+            if(tracer.isEnabled()) tracer.step(index);
+            int retpc = stmt->execute(status);
             if(ended) return true;
-            //qDebug()<<statements[pc]->getStatement();
+            //qDebug()<<stmt->getStatement();
             if(retpc == -1)
-                return false;
+                break;
             else if(retpc == 0){
-                //retpc = 0: no coontrol flow change
-                auto itr = statements.find(pc);
-                ++itr;
-                if(itr == statements.end())
-                    pc = -1;
-                else
-                    pc = itr->first;
+                //retpc = 0: no coontrol flow change,
+                //the next line is always the next entry of the plan
+                index++;
             }
             else if(retpc == -2){
                 //retpc = -2: END statement
                 return true;
             }
+            else if(retpc == -3){
+                //retpc = -3: RETURN, continue after the GOSUB
+                index = returnFromSubroutine(status);
+                if(!status.ok()) break;
+            }
             else{
-                if(statements.find(retpc) == statements.end()){
-                    QMessageBox::critical(parent, "Error", QString("Invalid GOTO line number %1 on Line %2").arg(retpc).arg(pc));
+                if(stmt->jumpIndex < 0){
+                    QString jump = stmt->type == StatementType::gosubStmt ? "GOSUB" : "GOTO";
+                    reportError("Error", QString("Invalid %1 line number %2 on Line %3").arg(jump).arg(retpc).arg(pc));
                     return false;
                 }
-                pc = retpc;//retpc != 0: control flow change
+                index = stmt->jumpIndex;//retpc != 0: control flow change
             }
         }
-        return true;
     }
     catch(std::exception& e){
-        QMessageBox::critical(parent, "Error", QString("Line %1: %2").arg(pc).arg(e.what()));
+        //only allocation failures are thrown
+        reportError("Error", QString("Line %1: %2").arg(pc).arg(e.what()));
         return false;
     }
+    if(status.ok()) return true;
+    status.setLine(pc);
+    reportError("Error", status);
+    return false;
 }
 
 /* Program::clear
 * Clear the program and the variables.
+* During a run (from the UI, while it waits for input or at a breakpoint)
+* the run is stopped and the statements and variables it uses are cleared
+* when it returns.
 */
 void Program::clear()
 {
-    for(auto it = statements.begin(); it != statements.end(); ++it) {
-        delete it->second;
-    }
     ended = true;
     debug = false;
-    parent->waitInput = false;
     breakpoint_blocked = false;
-    parent->ui->cmdLineEdit->setText("");
+    if(parent != nullptr) {
+        parent->waitInput = false;
+        parent->ui->cmdLineEdit->setText("");
+    }
+    currentVersion = ProgramVersion();
+    if(running) clearPending = true;
+    else clearState();
+    update();
+    updateTreeDisplay();
+}
+
+/* Program::clearState
+* Drop the statements, the parsed program and the variables.
+*/
+void Program::clearState()
+{
+    plan.clear();
+    parsed = false;
+    immediateCommands.clear();//their slots are about to go
     statements.clear();
+    statements.shrink();
+    builtVersion = ProgramVersion();
+    source = QString();
+    sourceGarbage = 0;
     variables.clear();
+    names.clear();
+    writeClock = 1;
+    loopDepth = 0;
+    callDepth = 0;
     pc = 0;
+}
+
+/* Program::syncStatements
+* Rebuild the statements from the current version of the program text.
+* The statements of the lines whose text did not change are moved over
+* with their parsed form; the others are made from the text. Nothing
+* changes during a run, which keeps the statements of its version.
+*/
+void Program::syncStatements()
+{
+    if(running || builtVersion.isSameAs(currentVersion)) return;
+    StatementTable built;
+    built.reserve(currentVersion.size());
+    std::vector<std::pair<int, const QString*>> added;//index in built, text
+    int old = 0;
+    bool changed = false;
+    currentVersion.forEach([&](int line, const QString& text) {
+        while(old < statements.size() && statements[old].line < line) {
+            old++;
+            changed = true;//deleted line
+        }
+        Statement* stmt = built.insert(line, this);
+        if(old < statements.size() && statements[old].line == line && statements[old].hasText(text)) {
+            *stmt = std::move(statements[old++]);
+            return;
+        }
+        if(old < statements.size() && statements[old].line == line) old++;
+        added.push_back({built.size() - 1, &text});
+        changed = true;
+    });
+    if(old < statements.size()) changed = true;
+    plan.clear();//points into the old statements
+    statements = std::move(built);
+    //the text is stored once the old statements released theirs, so that
+    //compacting the source buffer only sees the new statements
+    for(auto& [index, text] : added) statements[index].setStatement(*text);
+    builtVersion = currentVersion;
+    if(changed) parsed = false;
+}
+
+/* Program::setVersion
+* Replace the program text by version, which may be shared with other
+* programs.
+*/
+void Program::setVersion(const ProgramVersion& version)
+{
+    currentVersion = version;
     update();
-    updateTreeDisplay();
 }
 
 Program::~Program()
@@ -168,15 +426,18 @@ Program::~Program()
 }
 
 /* Program::update
-* Update the program to the UI.
+* Update the program to the UI. The text is set in one go: appending the
+* lines one by one takes seconds for a large program.
 */
 void Program::update()
 {
     if(parent != nullptr && !background) {
-        parent->ui->CodeDisplay->clear();
-        for(auto it = statements.begin(); it != statements.end(); ++it) {
-            parent->ui->CodeDisplay->append(QString::number(it->first) + " " + it->second->getStatement());
-        }
+        QString text;
+        currentVersion.forEach([&text](int line, const QString& statement) {
+            if(!text.isEmpty()) text += '\n';
+            text += QString::number(line) + " " + statement;
+        });
+        parent->ui->CodeDisplay->setPlainText(text);
         //updateTreeDisplay();
     }
 }
@@ -188,8 +449,8 @@ void Program::updateTreeDisplay()
 {
     if(parent != nullptr && !background) {
         parent->ui->treeDisplay->clear();
-        for(auto it = statements.begin(); it != statements.end(); ++it) {
-            parent->ui->treeDisplay->append(QString::number(it->first) + " " + it->second->getStatementTree());
+        for(Statement& stmt : statements) {
+            parent->ui->treeDisplay->append(QString::number(stmt.getLine()) + " " + stmt.getStatementTree());
         }
     }
 }
@@ -197,34 +458,228 @@ void Program::updateTreeDisplay()
 /* Program::output
 * Output the string s to the output window.
 */
-void Program::output(const QString& s)
+void Program::output(const QString& s, Status& status)
 {
+    if(limits.maxOutputLines && ++outputLines > limits.maxOutputLines){
+        status.fail(ErrorCode::outputLimit, QString(), limits.maxOutputLines);
+        return;
+    }
+    qint64 start = tracer.isEnabled() ? tracer.now() : 0;
     if(parent != nullptr) {
         parent->ui->textBrowser->append(s);
     }
+    else if(outputStream != nullptr) {
+        *outputStream << s << "\n";
+    }
+    if(tracer.isEnabled()) tracer.record(TraceKind::output, pc, start);
 }
 
 /* Program::input
-* Ask a value and store it in the variable s
+* Ask a value and store it in the variable slot
 */
-void Program::input(const QString& s)
+void Program::input(int slot, Status& status)
 {
-    if (!isValidVariableName(s)) {
-        throw std::invalid_argument("Invalid variable name: " + s.toStdString());
+    const QString& s = *variables[slot].name;
+    if (!variables[slot].validName) {
+        status.fail(ErrorCode::invalidVariableName, s);
+        return;
     }
 
-    
-    parent->waitInput = true;
-    parent->ui->cmdLineEdit->setText("?");
-    blockTillFalse(parent->waitInput);
-    variables[s] = parent->inputValue;
+    QElapsedTimer waitTimer;
+    waitTimer.start();
+    qint64 start = tracer.isEnabled() ? tracer.now() : 0;
+    if(parent == nullptr) {
+        //headless: read the value from the input stream
+        if(inputStream == nullptr || inputStream->atEnd()){
+            status.fail(ErrorCode::noInputLeft, s);
+            return;
+        }
+        bool ok;
+        QString line = inputStream->readLine().trimmed();
+        if(line.startsWith("?")) line = line.mid(1);
+        int value = line.toInt(&ok);
+        if(!ok){
+            status.fail(ErrorCode::invalidInput, line);
+            return;
+        }
+        setVariable(slot, value, status);
+    }
+    else {
+        parent->waitInput = true;
+        parent->ui->cmdLineEdit->setText("?");
+        blockTillFalse(parent->waitInput);
+        setVariable(slot, parent->inputValue, status);
+    }
+    if(tracer.isEnabled()) tracer.record(TraceKind::input, pc, start);
+    METRIC_INC(variableWrites);
+    METRIC_INC(inputWaits);
+    METRIC_ADD(inputWaitNs, waitTimer.nsecsElapsed());
     //qDebug() << "input variable: " << s << "input value: " << parent->inputValue;
 }
 
+/* Program::reportError
+* Show an error to the user: a message box when there is a window,
+* otherwise a line on stderr.
+*/
+void Program::reportError(const QString& title, const Status& status)
+{
+    if(status.getLine() > 0) reportError(title, QString("Line %1: %2").arg(status.getLine()).arg(status.message()));
+    else reportError(title, status.message());
+}
+
+void Program::reportError(const QString& title, const QString& message)
+{
+    if(parent != nullptr) {
+        QMessageBox::critical(parent, title, message);
+    }
+    else if(errorStream != nullptr) {
+        *errorStream << title << ": " << message << "\n";
+    }
+    else {
+        QTextStream err(stderr);
+        err << title << ": " << message << "\n";
+    }
+}
+
+/* Program::setLimits
+* Set the limits used by the following runs.
+*/
+void Program::setLimits(const ExecutionLimits& limits)
+{
+    this->limits = limits;
+    this->limits.maxCallDepth = std::clamp(limits.maxCallDepth, 1, maxCallStack);
+    calls.resize(this->limits.maxCallDepth);
+    callDepth = std::min(callDepth, this->limits.maxCallDepth);
+}
+
+/* Program::lineLabels
+* The text of every line, for the profiler reports.
+*/
+std::map<int, QString> Program::lineLabels()
+{
+    std::map<int, QString> labels;
+    builtVersion.forEach([&labels](int line, const QString& text) { labels.emplace_hint(labels.end(), line, text); });
+    return labels;
+}
+
+/* Program::setTrace
+* Trace the following runs into filename, see Tracer. An empty filename
+* turns tracing off.
+*/
+void Program::setTrace(const QString& filename, int sampleEvery, int capacity)
+{
+    traceFile = filename;
+    if(filename.isEmpty()) tracer.disable();
+    else tracer.enable(sampleEvery, capacity);
+}
+
+/* Program::setCoverage
+* Record the lines the following runs execute into filename, see Coverage.
+* sourceName is the program file named by lcov reports. An empty filename
+* turns coverage off.
+*/
+void Program::setCoverage(const QString& filename, const QString& sourceName)
+{
+    coverageFile = filename;
+    coverageSource = sourceName;
+    if(filename.isEmpty()) coverage.disable();
+    else coverage.enable();
+}
+
+/* Program::mergeCoverage
+* Add the lines of the JSON coverage report filename, written by runs of
+* the same program text, to the coverage the next run writes.
+*/
+bool Program::mergeCoverage(const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        reportError("Coverage Error", "Failed to open coverage file: " + filename);
+        return false;
+    }
+    QTextStream in(&file);
+    syncStatements();
+    QString error;
+    if(coverage.merge(in.readAll(), programHash(), error)) return true;
+    reportError("Coverage Error", error + ": " + filename);
+    return false;
+}
+
+/* Program::saveCoverage
+* Add the statements the run executed to the coverage and write it to
+* coverageFile.
+*/
+bool Program::saveCoverage()
+{
+    QVector<int> planLines, programLines;
+    for(const Statement* stmt : plan) planLines.append(stmt->line);
+    for(Statement& stmt : statements) programLines.append(stmt.getLine());
+    coverage.endRun(planLines, programLines, programHash());
+    if(coverage.save(coverageFile, coverageSource)) return true;
+    reportError("Coverage Error", "Failed to write coverage file: " + coverageFile);
+    return false;
+}
+
+/* Program::startLimits
+* Reset the usage counters at the start of a run.
+*/
+void Program::startLimits()
+{
+    stepsExecuted = 0;
+    limitChunk = 0;
+    limitCountdown = 0;
+    outputLines = 0;
+    expressionBytes = 0;
+    runTimer.start();
+}
+
+/* Program::checkLimits
+* Called when limitCountdown reaches zero: account for the steps of the
+* last chunk, check the step and time limits and start the next chunk.
+* The chunk never runs past the step limit, so the step limit is exact.
+*/
+void Program::checkLimits(Status& status)
+{
+    stepsExecuted += limitChunk;
+    if(limits.maxSteps && stepsExecuted >= limits.maxSteps){
+        status.fail(ErrorCode::stepLimit, QString(), limits.maxSteps);
+        return;
+    }
+    if(limits.maxWallMs && runTimer.elapsed() > limits.maxWallMs){
+        status.fail(ErrorCode::timeLimit, QString(), limits.maxWallMs);
+        return;
+    }
+    limitChunk = limitCheckInterval;
+    if(limits.maxSteps) limitChunk = std::min(limitChunk, limits.maxSteps - stepsExecuted);
+    limitCountdown = limitChunk;
+}
+
+/* Program::addExpressionMemory
+* Account for the expression trees and tapes of a parsed statement.
+*/
+void Program::addExpressionMemory(const Statement* stmt, Status& status)
+{
+    expressionBytes += (qint64)stmt->getNodeCount() * sizeof(ExpressionNode) + stmt->getTapeBytes();
+    if(limits.maxExpressionBytes && expressionBytes > limits.maxExpressionBytes)
+        status.fail(ErrorCode::memoryLimit, QString(), limits.maxExpressionBytes);
+}
+
+/* Program::setStreams
+* Set the input, output and error streams used when there is no parent
+* window. Errors go to stderr if err is nullptr.
+*/
+void Program::setStreams(QTextStream* in, QTextStream* out, QTextStream* err)
+{
+    inputStream = in;
+    outputStream = out;
+    errorStream = err;
+}
+
 /* Program::blockTillFalse
  * Block the program until the variable var is false.
  */
 void Program::blockTillFalse(volatile bool &var){
+    qint64 start = tracer.isEnabled() ? tracer.now() : 0;
     QEventLoop loop;
     //set a timer to check if the var is false
     QTimer timer;
@@ -235,6 +690,7 @@ void Program::blockTillFalse(volatile bool &var){
     });
     timer.start(10);
     loop.exec();
+    if(tracer.isEnabled()) tracer.record(TraceKind::blocked, pc, start);
 }
 
 /*------Debug mode------*/
@@ -306,8 +762,16 @@ bool Program::isBreakpoint(int line){
 */
 QString Program::showVariables(){
     QString res;
-    for(auto it = variables.begin(); it != variables.end(); ++it) {
-        res += it->first + " = " + QString::number(it->second) + "\n";
+    for(auto it = names.begin(); it != names.end(); ++it) {
+        const Variable& var = variables[it->second];
+        if(var.defined) res += it->first + " = " + QString::number(var.value) + "\n";
+        else if(var.isArray) {
+            res += it->first + "(" + QString::number(var.elements.size()) + ") =";
+            int shown = std::min<int>(var.elements.size(), maxShownElements);
+            for(int i = 0; i < shown; i++) res += " " + QString::number(var.elements[i]);
+            if(shown < (int)var.elements.size()) res += " ...";
+            res += "\n";
+        }
     }
     return res;
 }
@@ -347,50 +811,617 @@ void Program::resume(){
 }
 
 /* Program::parseAllStatements
-* Parse all statements in order of line number.
+* Parse the statements that are dirty: edited, or failed to parse, since
+* their last parse. Many of them are parsed in parallel.
+* The others keep their parsed form: a statement only refers to other
+* lines through their line numbers and to variables through the slots of
+* their names, which never change, and everything resolved from those is
+* rebuilt for every run (see buildExecutionPlan).
+* All syntax errors are collected and reported together, lowest line first.
 * Return false if any statement has syntax error.
 */
 bool Program::parseAllStatements()
 {
-    for(auto it = statements.begin(); it != statements.end(); ++it) {
-        try {
-            Statement* stmt = it->second;
-            if (stmt) {
-                stmt->parse();  // 这会抛出异常如果语法错误
-            }
-        } catch (const std::exception& e) {
-            if (!background) {
-                QMessageBox::critical(parent, "Syntax Error", 
-                    QString("Line %1: %2").arg(it->first).arg(e.what()));
-            }
+    syncStatements();
+    std::vector<ParseError> errors;
+    if(!parsed){
+        std::vector<int> dirty;
+        for(int i = 0; i < statements.size(); i++)
+            if(statements[i].dirty) dirty.push_back(i);
+        if((int)dirty.size() < parallelParseThreshold || QThread::idealThreadCount() < 2)
+            parseRange(dirty, 0, dirty.size(), errors);
+        else
+            parseInParallel(dirty, errors);
+        std::sort(errors.begin(), errors.end(),
+                  [](const ParseError& a, const ParseError& b){ return a.index < b.index; });
+        parsed = errors.empty();
+    }
+
+    //the memory limit is checked in line order, up to the first syntax error
+    expressionBytes = 0;
+    int firstError = errors.empty() ? statements.size() : errors.front().index;
+    for(int i = 0; i < firstError; i++) {
+        Status status;
+        addExpressionMemory(&statements[i], status);
+        if(!status.ok()) {
+            //limits exceeded while parsing
+            status.setLine(statements[i].getLine());
+            reportError("Error", status);
             return false;
         }
     }
+    if(errors.empty()) return true;
+    if (!background || parent == nullptr) {
+        QString message;
+        for(int i = 0; i < (int)errors.size() && i < maxReportedErrors; i++) {
+            if(i > 0) message += "\n";
+            message += QString("Line %1: %2").arg(statements[errors[i].index].getLine()).arg(errors[i].status.message());
+        }
+        if((int)errors.size() > maxReportedErrors)
+            message += QString("\n... and %1 more errors").arg((int)errors.size() - maxReportedErrors);
+        reportError("Syntax Error", message);
+    }
+    return false;
+}
+
+/* Program::parseRange
+* Parse the statements at indices [begin, end) and append their syntax
+* errors to errors.
+*/
+void Program::parseRange(const std::vector<int>& indices, int begin, int end, std::vector<ParseError>& errors)
+{
+    for(int i = begin; i < end; i++) {
+        Status status;
+        statements[indices[i]].parse(status);
+        if(!status.ok()) errors.push_back({indices[i], status});
+    }
+}
+
+/* Program::parseInParallel
+* Parse the statements at indices on the global thread pool and the
+* calling thread.
+* Statements are independent: each worker takes chunks of them, allocates
+* expression nodes from its own pool and counts its own metrics; both are
+* merged into the program when all workers are done.
+*/
+void Program::parseInParallel(const std::vector<int>& indices, std::vector<ParseError>& errors)
+{
+    struct Worker
+    {
+        NodePool pool;
+        Metrics counters;
+        std::vector<ParseError> errors;
+    };
+    int count = indices.size();
+    int chunks = (count + parseChunkSize - 1) / parseChunkSize;
+    int helpers = qMin(QThread::idealThreadCount(), chunks) - 1;
+    std::vector<Worker> workers(helpers);
+    std::atomic<int> nextChunk(0);
+    auto work = [&](std::vector<ParseError>& found) {
+        for(int chunk = nextChunk++; chunk < chunks; chunk = nextChunk++)
+            parseRange(indices, chunk * parseChunkSize, qMin(count, (chunk + 1) * parseChunkSize), found);
+    };
+
+    QSemaphore done;
+    for(Worker& worker : workers) {
+        QThreadPool::globalInstance()->start([&work, &worker, &done] {
+            workerNodePool = &worker.pool;
+            metrics.reset();
+            work(worker.errors);
+            worker.counters = metrics;
+            workerNodePool = nullptr;
+            done.release();
+        });
+    }
+    work(errors);//the calling thread uses the program's own pool
+    done.acquire(helpers);
+
+    for(Worker& worker : workers) {
+        nodePool.merge(worker.pool);
+        metrics.add(worker.counters);
+        errors.insert(errors.end(), worker.errors.begin(), worker.errors.end());
+    }
+}
+
+/*------Source buffer------*/
+
+/* Program::storeSource
+* Store s as the text of stmt in the shared source buffer.
+* The old text of stmt becomes garbage; the buffer is compacted once
+* the garbage outweighs the live text.
+*/
+void Program::storeSource(Statement& stmt, const QString& s)
+{
+    releaseSource(stmt.sourceLength);
+    stmt.sourceLength = 0;
+    if(sourceGarbage > 4096 && sourceGarbage > source.size() / 2) compactSource();
+    stmt.sourceOffset = source.size();
+    stmt.sourceLength = s.size();
+    source += s;
+}
+
+/* Program::releaseSource
+* Mark length characters of the source buffer as garbage.
+*/
+void Program::releaseSource(int length)
+{
+    sourceGarbage += length;
+}
+
+/* Program::compactSource
+* Rebuild the source buffer with the text of the current statements only.
+*/
+void Program::compactSource()
+{
+    QString compacted;
+    compacted.reserve(source.size() - sourceGarbage);
+    for(Statement& stmt : statements) {
+        int offset = compacted.size();
+        compacted.append(source.constData() + stmt.sourceOffset, stmt.sourceLength);
+        stmt.sourceOffset = offset;
+    }
+    source.swap(compacted);
+    sourceGarbage = 0;
+}
+
+/* Program::slotOf
+* Return the slot of the variable name, creating an undefined variable if
+* the name is new. All statements and expression nodes that use a variable
+* share its slot and the copy of its name kept in names, which is returned
+* in interned.
+*/
+int Program::slotOf(const QString& name, const QString** interned)
+{
+    QMutexLocker locker(&namesMutex);
+    auto it = names.emplace(name, (int)variables.size()).first;
+    if(it->second == (int)variables.size()) {
+        Variable var;
+        var.name = &it->first;
+        var.validName = isValidVariableName(name);
+        variables.push_back(var);
+    }
+    if(interned != nullptr) *interned = &it->first;
+    return it->second;
+}
+
+/* Program::setVariable
+* Store value in the variable slot and give the slot a new version.
+*/
+void Program::setVariable(int slot, int value, Status& status)
+{
+    Variable& var = variables[slot];
+    if(var.isArray){
+        status.fail(ErrorCode::arrayAsVariable, *var.name);
+        return;
+    }
+    var.value = value;
+    var.defined = true;
+    var.version = ++writeClock;
+}
+
+/* Program::dimArray
+* Make the variable slot an array of size elements, all 0.
+* An array that is dimensioned again starts over.
+*/
+void Program::dimArray(int slot, int size, Status& status)
+{
+    Variable& var = variables[slot];
+    if(size <= 0 || size > maxArraySize){
+        status.fail(ErrorCode::invalidArraySize, *var.name, size);
+        return;
+    }
+    var.elements.assign(size, 0);
+    var.isArray = true;
+    var.defined = false;
+    var.version = ++writeClock;
+}
+
+/* Program::enterLoop
+* Start the loop of the FOR statement on forLine, whose counter slot has
+* just been set to the start value. Return false if the loop runs no
+* iteration, otherwise push its frame. A FOR executed again while its
+* loop is active (jumped back to) first drops the old frame and the frames
+* of the loops inside it.
+*/
+bool Program::enterLoop(int forLine, int slot, int limit, int step, Status& status)
+{
+    for(int depth = loopDepth; depth > loopBase(); depth--) {
+        if(loops[depth - 1].forLine == forLine) {
+            loopDepth = depth - 1;
+            break;
+        }
+    }
+    int start = variables[slot].value;
+    if(step >= 0 ? start > limit : start < limit) return false;
+    if(loopDepth == maxLoopDepth){
+        status.fail(ErrorCode::tooManyLoops, QString(), maxLoopDepth);
+        return false;
+    }
+    loops[loopDepth++] = {forLine, slot, limit, step};
+    return true;
+}
+
+/* Program::nextIteration
+* Step the counter of the loop of the FOR statement on forLine.
+* Return true if the loop runs another iteration, otherwise pop its frame.
+* Frames of inner loops left with GOTO before their NEXT are dropped.
+* A subroutine only reaches the loops it entered itself.
+*/
+bool Program::nextIteration(int forLine, Status& status)
+{
+    int base = loopBase();
+    while(loopDepth > base && loops[loopDepth - 1].forLine != forLine) loopDepth--;
+    if(loopDepth == base){
+        status.fail(ErrorCode::nextWithoutFor);
+        return false;
+    }
+    const LoopFrame& loop = loops[loopDepth - 1];
+    Variable& counter = variables[loop.slot];
+    if(counter.isArray){
+        status.fail(ErrorCode::arrayAsVariable, *counter.name);
+        return false;
+    }
+    long long value = (long long)counter.value + loop.step;
+    counter.value = (int)value;
+    counter.version = ++writeClock;
+    if(loop.step >= 0 ? value <= loop.limit : value >= loop.limit) return true;
+    loopDepth--;
+    return false;
+}
+
+/* Program::callSubroutine
+* Push the call of the GOSUB statement on gosubLine, which returns to the
+* plan index returnIndex.
+*/
+void Program::callSubroutine(int gosubLine, int returnIndex, Status& status)
+{
+    if(callDepth == (int)calls.size()){
+        status.fail(ErrorCode::tooManyCalls, QString(), calls.size());
+        return;
+    }
+    calls[callDepth++] = {gosubLine, returnIndex, loopDepth};
+}
+
+/* Program::returnFromSubroutine
+* Pop the innermost call and return the plan index to continue at.
+* Loops the subroutine entered and did not finish are dropped.
+*/
+int Program::returnFromSubroutine(Status& status)
+{
+    if(callDepth == 0){
+        status.fail(ErrorCode::returnWithoutGosub);
+        return -1;
+    }
+    const CallFrame& call = calls[--callDepth];
+    loopDepth = call.loopMark;
+    return call.returnIndex;
+}
+
+/* Program::undefineVariables
+* Forget the values of all variables and arrays, keeping their slots.
+*/
+void Program::undefineVariables()
+{
+    for(Variable& var : variables) {
+        var.defined = false;
+        var.isArray = false;
+        std::vector<int>().swap(var.elements);
+        var.version = ++writeClock;
+    }
+}
+
+NodePool& Program::nodes()
+{
+    return workerNodePool != nullptr ? *workerNodePool : nodePool;
+}
+
+/* Program::memoryReport
+* Bytes held by the program representation, per structure.
+*/
+QString Program::memoryReport()
+{
+    syncStatements();
+    qint64 lines = statements.size();
+    qint64 statementBytes = statements.getBytesReserved();
+    qint64 sourceBytes = (qint64)source.capacity() * sizeof(QChar);
+    qint64 expressionBytes = 0;
+    for(Statement& stmt : statements) {
+        for(auto exp : stmt.expressions) if(exp) expressionBytes += sizeof(Expression) + exp->getTapeBytes();
+    }
+    qint64 nodeBytes = nodePool.getBytesReserved();
+    //a tree node and its shared_ptr control block, and the text it holds
+    qint64 versionBytes = 0;
+    currentVersion.forEach([&versionBytes](int, const QString& text) {
+        versionBytes += sizeof(ProgramVersion::Node) + sizeof(void*) + 2 * sizeof(int) + (qint64)text.capacity() * sizeof(QChar);
+    });
+    qint64 total = statementBytes + sourceBytes + expressionBytes + nodeBytes + versionBytes;
+    QString res;
+    res += QString("lines: %1\n").arg(lines);
+    res += QString("statement table: %1 bytes\n").arg(statementBytes);
+    res += QString("source buffer: %1 bytes (%2 garbage)\n").arg(sourceBytes).arg((qint64)sourceGarbage * (qint64)sizeof(QChar));
+    res += QString("expressions: %1 bytes\n").arg(expressionBytes);
+    res += QString("expression node pool: %1 bytes (%2 nodes in use)\n").arg(nodeBytes).arg((qint64)nodePool.getNodesInUse());
+    res += QString("program version: %1 bytes\n").arg(versionBytes);
+    res += QString("total: %1 bytes (%2 bytes/line)\n").arg(total).arg(lines ? total / lines : 0);
+    return res;
+}
+
+/*------Snapshot------*/
+
+static const quint32 snapshotMagic = 0x5142534E;//"QBSN"
+static const quint16 snapshotVersion = 4;//1: no arrays, 2: no loops, 3: no calls
+
+/* Program::programHash
+* FNV-1a hash of the program text. Snapshots store it so that they are
+* only restored into the program they were taken from.
+*/
+quint64 Program::programHash()
+{
+    quint64 hash = 14695981039346656037ULL;
+    auto mix = [&hash](quint64 v) {
+        hash ^= v;
+        hash *= 1099511628211ULL;
+    };
+    for(Statement& stmt : statements) {
+        mix(stmt.getLine());
+        const QChar* text = source.constData() + stmt.sourceOffset;
+        for(int i = 0; i < stmt.sourceLength; i++) mix(text[i].unicode());
+        mix('\n');
+    }
+    return hash;
+}
+
+/* Program::saveSnapshot
+* Save pc, the variables and the breakpoints to filename.
+* Format (QDataStream): magic, version, program hash, pc,
+* variable count, (name as UTF-8, value)..., breakpoint count, line...,
+* array count, (name as UTF-8, size, element...)...,
+* loop count, (FOR line, counter name as UTF-8, limit, step)... from the outermost
+*/
+bool Program::saveSnapshot(const QString& filename)
+{
+    syncStatements();
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        reportError("Snapshot Error", "Failed to open file: " + filename);
+        return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_15);
+    out << snapshotMagic << snapshotVersion << programHash() << (qint32)pc;
+    quint32 defined = 0;
+    for(const Variable& var : variables) defined += var.defined;
+    out << defined;
+    for(auto it = names.begin(); it != names.end(); ++it) {
+        const Variable& var = variables[it->second];
+        if(var.defined) out << it->first.toUtf8() << (qint32)var.value;
+    }
+    out << (quint32)breakpoints.size();
+    for(int line : breakpoints) out << (qint32)line;
+    quint32 arrays = 0;
+    for(const Variable& var : variables) arrays += var.isArray;
+    out << arrays;
+    for(auto it = names.begin(); it != names.end(); ++it) {
+        const Variable& var = variables[it->second];
+        if(!var.isArray) continue;
+        out << it->first.toUtf8() << (qint32)var.elements.size();
+        for(int element : var.elements) out << (qint32)element;
+    }
+    out << (quint32)loopDepth;
+    for(int i = 0; i < loopDepth; i++) {
+        const LoopFrame& loop = loops[i];
+        out << (qint32)loop.forLine << variables[loop.slot].name->toUtf8() << (qint32)loop.limit << (qint32)loop.step;
+    }
+    out << (quint32)callDepth;
+    for(int i = 0; i < callDepth; i++) out << (qint32)calls[i].gosubLine << (qint32)calls[i].loopMark;
     return true;
 }
 
+/* Program::loadSnapshot
+* Restore pc, the variables, the active loops and calls and the
+* breakpoints from filename.
+* The current state is left untouched if the file is not a valid snapshot
+* of this program.
+*/
+bool Program::loadSnapshot(const QString& filename)
+{
+    if(running) {
+        reportError("Snapshot Error", "The program is running");
+        return false;
+    }
+    syncStatements();
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        reportError("Snapshot Error", "Failed to open file: " + filename);
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_15);
+    quint32 magic;
+    quint16 version;
+    quint64 hash;
+    qint32 savedPc;
+    in >> magic >> version;
+    if(in.status() != QDataStream::Ok || magic != snapshotMagic || version < 1 || version > snapshotVersion) {
+        reportError("Snapshot Error", "Not a snapshot file (or unsupported version): " + filename);
+        return false;
+    }
+    in >> hash >> savedPc;
+    if(hash != programHash()) {
+        reportError("Snapshot Error", "The snapshot was taken from a different program: " + filename);
+        return false;
+    }
+
+    //names were written in order, so every insert goes to the end of the map
+    std::map<QString, int> savedVariables;
+    quint32 count;
+    in >> count;
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QByteArray name;
+        qint32 value;
+        in >> name >> value;
+        savedVariables.emplace_hint(savedVariables.end(), QString::fromUtf8(name), value);
+    }
+    std::set<int> savedBreakpoints;
+    in >> count;
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        qint32 line;
+        in >> line;
+        savedBreakpoints.insert(savedBreakpoints.end(), line);
+    }
+    std::map<QString, std::vector<int>> savedArrays;
+    count = 0;
+    if(version >= 2) in >> count;
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QByteArray name;
+        qint32 size;
+        in >> name >> size;
+        if(size <= 0 || size > maxArraySize) {
+            in.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+        std::vector<int>& elements = savedArrays[QString::fromUtf8(name)];
+        elements.resize(size);
+        for(int& element : elements) {
+            qint32 value;
+            in >> value;
+            element = value;
+        }
+    }
+    std::vector<std::pair<QString, LoopFrame>> savedLoops;
+    count = 0;
+    if(version >= 3) in >> count;
+    if(count > (quint32)maxLoopDepth) in.setStatus(QDataStream::ReadCorruptData);
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QByteArray counter;
+        qint32 forLine, limit, step;
+        in >> forLine >> counter >> limit >> step;
+        savedLoops.push_back({QString::fromUtf8(counter), LoopFrame{forLine, -1, limit, step}});
+    }
+    std::vector<CallFrame> savedCalls;
+    count = 0;
+    if(version >= 4) in >> count;
+    if(count > (quint32)maxCallStack) in.setStatus(QDataStream::ReadCorruptData);
+    for(quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        qint32 gosubLine, loopMark;
+        in >> gosubLine >> loopMark;
+        //calls return to existing lines and keep the loops of their callers
+        int lastMark = savedCalls.empty() ? 0 : savedCalls.back().loopMark;
+        if(statements.find(gosubLine) == nullptr || loopMark < lastMark || loopMark > (int)savedLoops.size())
+            in.setStatus(QDataStream::ReadCorruptData);
+        savedCalls.push_back({gosubLine, -1, loopMark});
+    }
+    if(in.status() != QDataStream::Ok) {
+        reportError("Snapshot Error", "Truncated snapshot file: " + filename);
+        return false;
+    }
+    if(savedCalls.size() > calls.size()) {
+        reportError("Snapshot Error", QString("The snapshot has %1 nested GOSUB calls, more than the call depth limit: %2")
+                    .arg(savedCalls.size()).arg(filename));
+        return false;
+    }
+
+    pc = savedPc;
+    undefineVariables();
+    Status status;//no variable is an array yet and the sizes are checked
+    for(auto it = savedVariables.begin(); it != savedVariables.end(); ++it) {
+        setVariable(slotOf(it->first), it->second, status);
+    }
+    for(auto it = savedArrays.begin(); it != savedArrays.end(); ++it) {
+        int slot = slotOf(it->first);
+        dimArray(slot, it->second.size(), status);
+        variables[slot].elements.swap(it->second);
+    }
+    loopDepth = 0;
+    for(auto& saved : savedLoops) {
+        saved.second.slot = slotOf(saved.first);
+        loops[loopDepth++] = saved.second;
+    }
+    callDepth = savedCalls.size();
+    std::copy(savedCalls.begin(), savedCalls.end(), calls.begin());
+    breakpoints.swap(savedBreakpoints);
+    if (!background) {
+        parent->updateBreakPoint(showBreakpoints());
+    }
+    return true;
+}
+
+/* Program::setSnapshotPoint
+* Save a snapshot to filename and stop when the run reaches line.
+*/
+void Program::setSnapshotPoint(int line, const QString& filename)
+{
+    snapshotLine = line;
+    snapshotFile = filename;
+}
+
+/* Program::getPc
+* The current line of the program.
+*/
+int Program::getPc() const
+{
+    return pc;
+}
+
+/*------Execution plan------*/
+
+/* Program::buildExecutionPlan
+* Build the execution plan of a run starting at entryLine from the parsed statements:
+* - thread GOTO chains to their final target (not in debug mode,
+*   so that every breakpoint is still hit),
+* - drop the statements that can never be reached,
+* - share the values of the subexpressions repeated in a basic block,
+* - resolve jump targets, and the return addresses of the calls a resumed
+*   run starts in, to plan indices.
+*/
+void Program::buildExecutionPlan(int entryLine)
+{
+    cfg.matchLoops(statements);
+    cfg.resetJumps(statements);
+    if(!debug) cfg.threadJumps(statements);
+    QVector<int> activeCalls;//a resumed run also continues after these GOSUBs
+    for(int i = 0; i < callDepth; i++) activeCalls.push_back(calls[i].gosubLine);
+    cfg.build(statements, entryLine, activeCalls);
+    cfg.proveBounds(statements, variables.size());
+    sharedSources.assign(cfg.shareSubexpressions(statements), nullptr);
+    plan.clear();
+    for(int i = 0; i < statements.size(); i++) {
+        Statement* stmt = &statements[i];
+        stmt->planIndex = -1;
+        stmt->jumpIndex = -1;
+        if(cfg.isReachable(i)) {
+            stmt->planIndex = plan.size();
+            plan.push_back(stmt);
+        }
+    }
+    for(Statement* stmt : plan) {
+        if(!stmt->isJump()) continue;
+        Statement* target = statements.find(stmt->jumpLine);
+        if(target != nullptr) stmt->jumpIndex = target->planIndex;
+    }
+    for(int i = 0; i < callDepth; i++) {
+        int next = statements.indexOf(calls[i].gosubLine) + 1;
+        calls[i].returnIndex = next < statements.size() ? statements[next].planIndex : plan.size();
+    }
+}
+
+/* Program::showControlFlowGraph
+* Show the control flow graph built by the last RUN.
+*/
+QString Program::showControlFlowGraph()
+{
+    if(cfg.getBlocks().isEmpty()) return "No control flow graph yet: RUN the program first.\n";
+    return cfg.report();
+}
+
 /* Program::isValidVariableName
 * Check if the variable name is valid.
 * Rules:
 * 1. Must start with a letter or underscore
 * 2. Can only contain letters, numbers, and underscores
 * 3. Cannot be a keyword
+* See isValidName in lexicon.cpp.
 */
 bool Program::isValidVariableName(const QString& name) const {
-    if (name.isEmpty()) return false;
-    
-    // 检查是否是关键字
-    if (keywords.find(name) != keywords.end()) return false;
-    
-    // 检查首字符
-    QChar first = name[0];
-    if (!first.isLetter() && first != '_') return false;
-    
-    // 检查其他字符
-    for (int i = 1; i < name.length(); i++) {
-        QChar c = name[i];
-        if (!c.isLetterOrNumber() && c != '_') return false;
-    }
-    
-    return true;
-}
\ No newline at end of file
+    return isValidName(name);
+}
@@ -2,36 +2,190 @@
 #define PROGRAM_H
 
 #include <QString>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QMutex>
 #include <map>
+#include <memory>
 #include <set>
+#include <vector>
 #include "statement.h"
+#include "status.h"
+#include "cfg.h"
+#include "trace.h"
+#include "coverage.h"
+#include "version.h"
 
 class MainWindow;
+struct LockstepResult;
 class Tokenizer;
+class QTextStream;
+
+/*
+ * ExecutionLimits
+ * Limits of a single RUN, 0 means unlimited.
+ * A run that exceeds one of them is stopped with a line-numbered error.
+ * maxCallDepth is never unlimited: the return stack is allocated at that
+ * depth when the limits are set.
+*/
+struct ExecutionLimits
+{
+    qint64 maxSteps = 0;//executed statements
+    qint64 maxWallMs = 0;//wall time of the run in milliseconds
+    qint64 maxOutputLines = 0;//lines written by PRINT
+    qint64 maxExpressionBytes = 0;//memory held by the parsed expression trees and tapes
+    int maxCallDepth = 256;//nested GOSUB calls
+};
 
 class Program
 {
 private:
     bool background=false;
     MainWindow *parent;
-    const std::set<QString> keywords = {
-        "LOAD", "RUN", "CLEAR", "QUIT", "LIST", "ADD", "DELETE", "PRINT", "LET", "INPUT",
-        "GOTO", "IF", "THEN", "END", "REM", "MOD"
-    };
+/* Used instead of the UI when there is no parent window (headless runner).*/
+    QTextStream *inputStream=nullptr;
+    QTextStream *outputStream=nullptr;
+    QTextStream *errorStream=nullptr;//stderr if not set
     bool isValidVariableName(const QString& name) const;
+/* Shared storage of the program: expression nodes, variable names and
+ * the text of all statements. Declared before the statements, which
+ * release into them when they are destroyed.*/
+    NodePool nodePool;
+    NodePool& nodes();//nodePool, or the pool of the current parse worker
+    std::map<QString, int> names;//variable slot of every name
+    QMutex namesMutex;//slots are created by the parse workers too
+    QString source;
+    int sourceGarbage=0;//characters of source no longer used by a statement
+    void storeSource(Statement& stmt, const QString& s);
+    void releaseSource(int length);
+    void compactSource();
+    int slotOf(const QString& name, const QString** interned = nullptr);
+/* Text of the program. An edit only replaces currentVersion, so it never
+ * touches the statements a run is executing: the statements are rebuilt
+ * from currentVersion when a run starts, and builtVersion pins the version
+ * they were built from until the next one.*/
+    ProgramVersion currentVersion;
+    ProgramVersion builtVersion;
+    bool running=false;
+    bool clearPending=false;//clear() was called during the run
+    void syncStatements();
+    void clearState();
 /* Statements of the program.*/
     int pc;//program counter: the current line number of the program
-    std::map<int, Statement*> statements;
-/* Pool of variables.*/
-    std::map<QString, int> variables;
+    StatementTable statements;
+/* Execution plan: the reachable statements in order of line number,
+ * with jumps resolved to plan indices. Rebuilt on every RUN.*/
+/* Immediate mode: commands entered outside the program run against its
+ * variables. The compiled statements of the last commands are kept by
+ * their text, so a command entered again is not parsed again.*/
+    struct ImmediateCommand
+    {
+        std::unique_ptr<Statement> statement;
+        quint64 lastUse;
+    };
+    std::map<QString, ImmediateCommand> immediateCommands;
+    quint64 immediateClock=0;
+    Statement* immediateStatement(const QString& s, Status& status);
+    bool parsed=false;//all statements parsed without error since the last change
+    QVector<Statement*> plan;
+    ControlFlowGraph cfg;
+    void buildExecutionPlan(int entryLine);
+    bool runPlan(int index);
+/* Parsing of the dirty statements, split over a thread pool when there
+ * are many.*/
+    struct ParseError
+    {
+        int index;//index of the statement in statements
+        Status status;
+    };
+    void parseRange(const std::vector<int>& indices, int begin, int end, std::vector<ParseError>& errors);
+    void parseInParallel(const std::vector<int>& indices, std::vector<ParseError>& errors);
+/* Pool of variables, indexed by the slots the statements and expression
+ * nodes resolve their names to when they are parsed. Every write stamps
+ * the slot with the next writeClock value, which is what the memoized
+ * subexpressions are checked against (see Expression::isMemoValid).
+ * A slot holds either a value or, after DIM, the elements of an array.*/
+    struct Variable
+    {
+        const QString* name;//owned by names
+        bool validName;
+        bool defined = false;
+        bool isArray = false;
+        int value = 0;
+        quint64 version = 0;
+        std::vector<int> elements;
+    };
+    std::vector<Variable> variables;
+    static const int maxArraySize = 1 << 24;//largest array DIM accepts, in elements
+    quint64 writeClock = 1;
+/* The occurrence that computed every subexpression a basic block repeats
+ * last (see ControlFlowGraph::shareSubexpressions), reset with the plan.*/
+    std::vector<const TapeEntry*> sharedSources;
+    void setVariable(int slot, int value, Status& status);
+    void dimArray(int slot, int size, Status& status);
+    void undefineVariables();
+/* Active FOR loops, innermost last, in a stack allocated with the program.
+ * NEXT finds its loop on top and updates the counter slot in place.*/
+    struct LoopFrame
+    {
+        int forLine;//line of the FOR statement
+        int slot;//counter variable
+        int limit;
+        int step;
+    };
+    static const int maxLoopDepth = 64;
+    LoopFrame loops[maxLoopDepth];
+    int loopDepth = 0;
+    bool enterLoop(int forLine, int slot, int limit, int step, Status& status);
+    bool nextIteration(int forLine, Status& status);
+/* Active GOSUB calls, innermost last, in a stack allocated by setLimits.
+ * A call saves the plan index to return to and the depth of the loop
+ * stack: the loops of the caller are out of reach of the subroutine and
+ * RETURN drops the loops the subroutine left open.*/
+    struct CallFrame
+    {
+        int gosubLine;//line of the GOSUB statement
+        int returnIndex;//plan index of the statement after it
+        int loopMark;//loopDepth at the call
+    };
+    std::vector<CallFrame> calls;
+    int callDepth = 0;
+    int loopBase() const { return callDepth > 0 ? calls[callDepth - 1].loopMark : 0; }
+    void callSubroutine(int gosubLine, int returnIndex, Status& status);
+    int returnFromSubroutine(Status& status);
 /* Useful in debug mode*/
     bool debug=false;
+/* Limits of a run. The step and time limits are checked every time
+ * limitCountdown reaches zero instead of on every step.*/
+    ExecutionLimits limits;
+    qint64 stepsExecuted=0;
+    qint64 limitChunk=0;
+    qint64 limitCountdown=0;
+    qint64 outputLines=0;
+    qint64 expressionBytes=0;
+    QElapsedTimer runTimer;
+    void startLimits();
+    void checkLimits(Status& status);
+    void addExpressionMemory(const Statement* stmt, Status& status);
     volatile bool breakpoint_blocked=false;
     volatile bool ended=false;
     std::set<int> breakpoints;
+/* Timeline of the runs, written to traceFile at the end of every run.*/
+    Tracer tracer;
+    QString traceFile;
+/* Lines that ran, written to coverageFile at the end of every run.*/
+    Coverage coverage;
+    QString coverageFile;
+    QString coverageSource;//file name of the program in lcov reports
+    bool saveCoverage();
+/* Snapshot taken when the run reaches snapshotLine (0: never).*/
+    int snapshotLine=0;
+    QString snapshotFile;
+    quint64 programHash();
 friend class Statement;
 friend class Tokenizer;
 friend class Expression;
+friend class Lockstep;
 
 public:
     void blockTillFalse(volatile bool &var);
@@ -40,12 +194,21 @@ public:
     Program(MainWindow *parent, bool background = false);
     bool updateStatement(int line, const QString& s);
     bool execute();
+    bool executeFrom(int line);
+    bool executeLockstep(const std::vector<QStringList>& inputs, std::vector<LockstepResult>& results);
     void init();
     void clear();
     void update();
     void updateTreeDisplay();
-    void output(const QString& s);
-    void input(const QString& s);//Ask a value and store it in the variable s
+    void output(const QString& s, Status& status);
+    void input(int slot, Status& status);//Ask a value and store it in the variable slot
+    void reportError(const QString& title, const QString& message);
+    void reportError(const QString& title, const Status& status);
+    void setStreams(QTextStream* in, QTextStream* out, QTextStream* err = nullptr);
+    void setLimits(const ExecutionLimits& limits);
+    void setTrace(const QString& filename, int sampleEvery = 1, int capacity = Tracer::defaultCapacity);
+    void setCoverage(const QString& filename, const QString& sourceName = QString());
+    bool mergeCoverage(const QString& filename);
     ~Program();
 /* Debug mode*/
     bool inDebugMode();
@@ -58,8 +221,21 @@ public:
     QString showBreakpoints();
     void exitDebug();
     void resume();
-    void executeStatement(const QString& s);
+    bool executeStatement(const QString& s);
     bool parseAllStatements();
+    QString showControlFlowGraph();
+    QString memoryReport();
+    std::map<int, QString> lineLabels();
+    int lineCount() const { return currentVersion.size(); }
+/* Versions: a version can be shared by several programs, each running it
+ * with its own variables.*/
+    ProgramVersion getVersion() const { return currentVersion; }
+    void setVersion(const ProgramVersion& version);
+/* Snapshot*/
+    bool saveSnapshot(const QString& filename);
+    bool loadSnapshot(const QString& filename);
+    void setSnapshotPoint(int line, const QString& filename);
+    int getPc() const;
 };
 
 #endif // PROGRAM_H
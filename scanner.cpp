@@ -0,0 +1,257 @@
+#include "scanner.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define SCANNER_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+enum CharClass { blankClass, digitClass, identifierClass, sameClass, otherClass };
+//sameClass: the characters equal to c, otherClass: the characters different from c
+
+template<CharClass cls>
+inline bool inClass(ushort u, ushort c)
+{
+    switch(cls){
+    case blankClass: return Scanner::isBlank(u);
+    case digitClass: return Scanner::isDigit(u);
+    case identifierClass: return Scanner::isIdentifierChar(u);
+    case sameClass: return u == c;
+    case otherClass: return u != c;
+    }
+    return false;
+}
+
+template<CharClass cls>
+int skipScalar(const ushort* s, int from, int to, ushort c)
+{
+    while(from < to && inClass<cls>(s[from], c)) from++;
+    return from;
+}
+
+#ifdef SCANNER_X86
+/*
+ * The vector versions compare 16 bit lanes. The compares are signed, so
+ * characters from U+8000 up are negative and fall outside every range.
+*/
+template<CharClass cls>
+inline __m128i classMask(__m128i v, __m128i c)
+{
+    switch(cls){
+    case blankClass:
+        return _mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16(' ')),
+                            _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16('\t' - 1)),
+                                          _mm_cmplt_epi16(v, _mm_set1_epi16('\r' + 1))));
+    case digitClass:
+        return _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16('0' - 1)),
+                             _mm_cmplt_epi16(v, _mm_set1_epi16('9' + 1)));
+    case identifierClass:{
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi16(0x20));
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi16(lower, _mm_set1_epi16('a' - 1)),
+                                       _mm_cmplt_epi16(lower, _mm_set1_epi16('z' + 1)));
+        return _mm_or_si128(_mm_or_si128(letter, classMask<digitClass>(v, c)),
+                            _mm_cmpeq_epi16(v, _mm_set1_epi16('_')));
+    }
+    case sameClass: return _mm_cmpeq_epi16(v, c);
+    case otherClass: return _mm_xor_si128(_mm_cmpeq_epi16(v, c), _mm_set1_epi16(-1));
+    }
+    return _mm_setzero_si128();
+}
+
+template<CharClass cls>
+inline int skipSse2Block(const ushort* s, int from, int to, __m128i vc)
+{
+    for(; from + 8 <= to; from += 8){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + from));
+        unsigned outside = ~_mm_movemask_epi8(classMask<cls>(v, vc)) & 0xFFFF;
+        if(outside) return from + (__builtin_ctz(outside) >> 1);
+    }
+    if(from < to){
+        //the last block overlaps characters already known to be in the class
+        int last = to - 8;
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + last));
+        unsigned outside = ~_mm_movemask_epi8(classMask<cls>(v, vc)) & 0xFFFF;
+        if(outside) return last + (__builtin_ctz(outside) >> 1);
+    }
+    return to;
+}
+
+template<CharClass cls>
+int skipSse2(const ushort* s, int from, int to, ushort c)
+{
+    if(to - from < 8) return skipScalar<cls>(s, from, to, c);
+    return skipSse2Block<cls>(s, from, to, _mm_set1_epi16(c));
+}
+
+template<CharClass cls>
+__attribute__((target("avx2"))) inline __m256i classMask256(__m256i v, __m256i c)
+{
+    switch(cls){
+    case blankClass:
+        return _mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16(' ')),
+                               _mm256_and_si256(_mm256_cmpgt_epi16(v, _mm256_set1_epi16('\t' - 1)),
+                                                _mm256_cmpgt_epi16(_mm256_set1_epi16('\r' + 1), v)));
+    case digitClass:
+        return _mm256_and_si256(_mm256_cmpgt_epi16(v, _mm256_set1_epi16('0' - 1)),
+                                _mm256_cmpgt_epi16(_mm256_set1_epi16('9' + 1), v));
+    case identifierClass:{
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi16(0x20));
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi16(lower, _mm256_set1_epi16('a' - 1)),
+                                          _mm256_cmpgt_epi16(_mm256_set1_epi16('z' + 1), lower));
+        return _mm256_or_si256(_mm256_or_si256(letter, classMask256<digitClass>(v, c)),
+                               _mm256_cmpeq_epi16(v, _mm256_set1_epi16('_')));
+    }
+    case sameClass: return _mm256_cmpeq_epi16(v, c);
+    case otherClass: return _mm256_xor_si256(_mm256_cmpeq_epi16(v, c), _mm256_set1_epi16(-1));
+    }
+    return _mm256_setzero_si256();
+}
+
+template<CharClass cls>
+__attribute__((target("avx2"))) int skipAvx2(const ushort* s, int from, int to, ushort c)
+{
+    if(to - from < 8) return skipScalar<cls>(s, from, to, c);
+    if(to - from < 16) return skipSse2Block<cls>(s, from, to, _mm_set1_epi16(c));
+    __m256i vc = _mm256_set1_epi16(c);
+    for(; from + 16 <= to; from += 16){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + from));
+        unsigned outside = ~static_cast<unsigned>(_mm256_movemask_epi8(classMask256<cls>(v, vc)));
+        if(outside) return from + (__builtin_ctz(outside) >> 1);
+    }
+    if(from < to){
+        int last = to - 16;
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + last));
+        unsigned outside = ~static_cast<unsigned>(_mm256_movemask_epi8(classMask256<cls>(v, vc)));
+        if(outside) return last + (__builtin_ctz(outside) >> 1);
+    }
+    return to;
+}
+#endif
+
+typedef int (*SkipFunction)(const ushort*, int, int, ushort);
+
+/*
+ * One table of skip functions per level, indexed by CharClass.
+*/
+const SkipFunction scalarTable[] = {
+    skipScalar<blankClass>, skipScalar<digitClass>, skipScalar<identifierClass>,
+    skipScalar<sameClass>, skipScalar<otherClass>
+};
+#ifdef SCANNER_X86
+const SkipFunction sse2Table[] = {
+    skipSse2<blankClass>, skipSse2<digitClass>, skipSse2<identifierClass>,
+    skipSse2<sameClass>, skipSse2<otherClass>
+};
+const SkipFunction avx2Table[] = {
+    skipAvx2<blankClass>, skipAvx2<digitClass>, skipAvx2<identifierClass>,
+    skipAvx2<sameClass>, skipAvx2<otherClass>
+};
+#endif
+
+Scanner::Level detectLevel()
+{
+#ifdef SCANNER_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return Scanner::avx2Level;
+    return Scanner::sse2Level;
+#else
+    return Scanner::scalarLevel;
+#endif
+}
+
+const SkipFunction* tableOf(Scanner::Level level)
+{
+#ifdef SCANNER_X86
+    if(level == Scanner::avx2Level) return avx2Table;
+    if(level == Scanner::sse2Level) return sse2Table;
+#endif
+    return scalarTable;
+}
+
+//start with the scalar table so that scans during static initialization work
+Scanner::Level currentLevel = Scanner::scalarLevel;
+const SkipFunction* table = scalarTable;
+
+inline const ushort* units(const QChar* data)
+{
+    return reinterpret_cast<const ushort*>(data);
+}
+
+}
+
+namespace Scanner
+{
+Level level()
+{
+    return currentLevel;
+}
+
+Level bestLevel()
+{
+    static const Level best = detectLevel();
+    return best;
+}
+
+void setLevel(Level level)
+{
+    currentLevel = level > bestLevel() ? bestLevel() : level;
+    table = tableOf(currentLevel);
+}
+
+const char* levelName(Level level)
+{
+    switch(level){
+    case avx2Level: return "avx2";
+    case sse2Level: return "sse2";
+    default: return "scalar";
+    }
+}
+
+//switch to the best level once the scanner is initialized
+static const bool bestLevelSelected = (setLevel(bestLevel()), true);
+
+int scanBlanks(const QChar* data, int from, int to)
+{
+    return table[blankClass](units(data), from, to, 0);
+}
+
+int scanDigits(const QChar* data, int from, int to)
+{
+    return table[digitClass](units(data), from, to, 0);
+}
+
+int scanIdentifier(const QChar* data, int from, int to)
+{
+    return table[identifierClass](units(data), from, to, 0);
+}
+
+int scanChar(const QChar* data, int from, int to, QChar c)
+{
+    return table[sameClass](units(data), from, to, c.unicode());
+}
+
+int findChar(const QChar* data, int from, int to, QChar c)
+{
+    return table[otherClass](units(data), from, to, c.unicode());
+}
+
+/* Scanner::collapseSpaces
+* Drop the leading spaces of s and replace every other run of spaces by one.
+*/
+QString collapseSpaces(const QString& s)
+{
+    QString result;
+    result.reserve(s.size());
+    const QChar* data = s.constData();
+    int i = skipChar(data, 0, s.size(), ' ');
+    while(i < s.size()){
+        int space = findChar(data, i, s.size(), ' ');
+        result.append(data + i, space - i);
+        if(space == s.size()) break;
+        result += ' ';
+        i = skipChar(data, space, s.size(), ' ');
+    }
+    return result;
+}
+}
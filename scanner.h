@@ -0,0 +1,76 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <QString>
+#include "lexicon.h"
+
+/*
+ * Scanner
+ * Finds the end of a run of characters of one class in UTF-16 text.
+ * On x86 the text is classified 16 or 32 bytes at a time (SSE2/AVX2);
+ * the best level supported by the CPU is selected when the program starts,
+ * other platforms use the plain character loop.
+ * Every skip function scans data[from, to) and returns the index of the
+ * first character that does not belong to the class, or to.
+*/
+namespace Scanner
+{
+enum Level { scalarLevel, sse2Level, avx2Level };
+
+Level level();
+Level bestLevel();
+void setLevel(Level level);//for benchmarks, clamped to bestLevel()
+const char* levelName(Level level);
+
+inline bool isBlank(QChar c){ return isCharClass(c, blankChar); }//ASCII white space
+inline bool isDigit(QChar c){ return isCharClass(c, digitChar); }
+inline bool isIdentifierChar(QChar c){ return isCharClass(c, letterChar | digitChar | underscoreChar); }
+
+//vector scans behind the skip functions below
+int scanBlanks(const QChar* data, int from, int to);
+int scanDigits(const QChar* data, int from, int to);
+int scanIdentifier(const QChar* data, int from, int to);
+int scanChar(const QChar* data, int from, int to, QChar c);
+int findChar(const QChar* data, int from, int to, QChar c);
+
+//Most runs between tokens are a few characters long: the first shortRun
+//characters are checked inline and only longer runs use the vector scan.
+const int shortRun = 8;
+
+inline int skipBlanks(const QChar* data, int from, int to)
+{
+    for(int end = from + shortRun < to ? from + shortRun : to; from < end; from++)
+        if(!isBlank(data[from])) return from;
+    return from == to ? to : scanBlanks(data, from, to);
+}
+
+inline int skipDigits(const QChar* data, int from, int to)
+{
+    for(int end = from + shortRun < to ? from + shortRun : to; from < end; from++)
+        if(!isDigit(data[from])) return from;
+    return from == to ? to : scanDigits(data, from, to);
+}
+
+inline int skipIdentifier(const QChar* data, int from, int to)
+{
+    for(int end = from + shortRun < to ? from + shortRun : to; from < end; from++)
+        if(!isIdentifierChar(data[from])) return from;
+    return from == to ? to : scanIdentifier(data, from, to);
+}
+
+inline int skipChar(const QChar* data, int from, int to, QChar c)
+{
+    for(int end = from + shortRun < to ? from + shortRun : to; from < end; from++)
+        if(data[from] != c) return from;
+    return from == to ? to : scanChar(data, from, to, c);
+}
+
+QString collapseSpaces(const QString& s);//drop leading spaces, one space per run
+
+inline int findLineBreak(const QChar* data, int from, int to)
+{
+    return findChar(data, from, to, QChar('\n'));
+}
+}
+
+#endif
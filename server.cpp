@@ -0,0 +1,535 @@
+#include "server.h"
+#include "headless.h"
+#include "program.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QIODevice>
+#include <QMutex>
+#include <QSemaphore>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <list>
+#include <memory>
+#include <vector>
+#if defined(Q_OS_UNIX)
+#include <cerrno>
+#include <cstring>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if defined(Q_OS_UNIX)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0//SIGPIPE is ignored instead
+#endif
+
+//Largest program or input a request may carry.
+static const qint64 maxRequestBytes = 64 << 20;
+//Longest header line of a request or a response frame.
+static const int maxHeaderLength = 256;
+//Programs a worker keeps parsed, by default.
+static const int defaultCacheSize = 16;
+
+/* writeAll
+* Send all of data on the socket. Return false if the peer is gone.
+*/
+static bool writeAll(int fd, const char* data, qint64 length)
+{
+    while(length > 0){
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const QByteArray& data)
+{
+    return writeAll(fd, data.constData(), data.size());
+}
+
+/* connectTo
+* A socket connected to the server at path, -1 on failure.
+*/
+static int connectTo(const QString& path)
+{
+    QByteArray name = path.toLocal8Bit();
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(name.size() >= (int)sizeof(address.sun_path)) return -1;
+    memcpy(address.sun_path, name.constData(), name.size());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    if(::connect(fd, (sockaddr*)&address, sizeof(address)) != 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * SocketReader
+ * Buffered reads of header lines and of byte counts from a socket.
+*/
+class SocketReader
+{
+public:
+    explicit SocketReader(int fd) : fd(fd) {}
+    bool readLine(QByteArray& line);//without the '\n', false at the end of the stream
+    bool read(QByteArray& data, qint64 length);
+private:
+    int fd;
+    QByteArray buffer;
+    int pos = 0;//start of the unread bytes in buffer
+    bool fill();
+};
+
+bool SocketReader::fill()
+{
+    if(pos > 0){
+        buffer.remove(0, pos);
+        pos = 0;
+    }
+    char chunk[1 << 16];
+    ssize_t n;
+    do n = recv(fd, chunk, sizeof(chunk), 0);
+    while(n < 0 && errno == EINTR);
+    if(n <= 0) return false;
+    buffer.append(chunk, n);
+    return true;
+}
+
+bool SocketReader::readLine(QByteArray& line)
+{
+    for(;;){
+        int end = buffer.indexOf('\n', pos);
+        if(end >= 0){
+            line = buffer.mid(pos, end - pos);
+            pos = end + 1;
+            return true;
+        }
+        if(buffer.size() - pos > maxHeaderLength || !fill()) return false;
+    }
+}
+
+bool SocketReader::read(QByteArray& data, qint64 length)
+{
+    if(length < 0 || length > maxRequestBytes) return false;
+    while(buffer.size() - pos < length)
+        if(!fill()) return false;
+    data = buffer.mid(pos, length);
+    pos += length;
+    return true;
+}
+
+/*
+ * FrameDevice
+ * Write-only device that sends everything written to it as "<tag> <n>\n"
+ * frames: the output and error streams of a run on the server.
+ * Once the peer is gone the rest of the run's output is dropped.
+*/
+class FrameDevice : public QIODevice
+{
+public:
+    FrameDevice(int fd, const char* tag) : fd(fd), tag(tag) { open(QIODevice::WriteOnly | QIODevice::Unbuffered); }
+    bool isBroken() const { return broken; }
+protected:
+    qint64 readData(char*, qint64) override { return -1; }
+    qint64 writeData(const char* data, qint64 length) override
+    {
+        if(!broken){
+            QByteArray header = QByteArray(tag) + " " + QByteArray::number(length) + "\n";
+            broken = !writeAll(fd, header) || !writeAll(fd, data, length);
+        }
+        return length;
+    }
+private:
+    int fd;
+    const char* tag;
+    bool broken = false;
+};
+
+/* sourceHash
+* FNV-1a hash of the text of a program, the key of the worker caches.
+*/
+static quint64 sourceHash(const QString& source)
+{
+    quint64 hash = 14695981039346656037ULL;
+    for(QChar c : source){
+        hash ^= c.unicode();
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Worker
+ * What a server thread keeps between requests: the programs it ran last,
+ * loaded and parsed, most recently used first.
+*/
+class Worker
+{
+public:
+    Worker(const ExecutionLimits& limits, int cacheSize) : limits(limits), cacheSize(cacheSize) {}
+    void serve(int fd);
+private:
+    struct CachedProgram
+    {
+        quint64 hash;
+        QString source;
+        std::unique_ptr<Program> program;
+    };
+    ExecutionLimits limits;
+    int cacheSize;
+    std::list<CachedProgram> cache;
+    bool runRequest(int fd, const QByteArray& programText, const QByteArray& inputText);
+};
+
+/* Worker::serve
+* Answer the requests of a connection until the client closes it or sends
+* something that is not a request.
+*/
+void Worker::serve(int fd)
+{
+    SocketReader reader(fd);
+    QByteArray header;
+    while(reader.readLine(header)){
+        QList<QByteArray> fields = header.split(' ');
+        bool programOk = false, inputOk = false;
+        qint64 programBytes = 0, inputBytes = 0;
+        if(fields.size() == 3 && fields[0] == "RUN"){
+            programBytes = fields[1].toLongLong(&programOk);
+            inputBytes = fields[2].toLongLong(&inputOk);
+        }
+        QByteArray programText, inputText;
+        if(!programOk || !inputOk || !reader.read(programText, programBytes) || !reader.read(inputText, inputBytes)){
+            QByteArray message = "Invalid request\n";
+            writeAll(fd, "ERR " + QByteArray::number(message.size()) + "\n" + message + "END 1 0 0 0\n");
+            break;
+        }
+        if(!runRequest(fd, programText, inputText)) break;
+    }
+    close(fd);
+}
+
+/* Worker::runRequest
+* Run a program with its input, streaming the output and the errors, and
+* end the response with the status and the timing.
+* Return false if the client is gone.
+*/
+bool Worker::runRequest(int fd, const QByteArray& programText, const QByteArray& inputText)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QString source = QString::fromUtf8(programText);
+    quint64 hash = sourceHash(source);
+    auto hit = std::find_if(cache.begin(), cache.end(), [&](const CachedProgram& cached) {
+        return cached.hash == hash && cached.source == source;
+    });
+    bool cached = hit != cache.end();
+    if(cached) cache.splice(cache.begin(), cache, hit);
+    else {
+        cache.push_front(CachedProgram{hash, source, std::make_unique<Program>(nullptr, true)});
+        cache.front().program->setLimits(limits);
+    }
+    Program& program = *cache.front().program;
+
+    QString input = QString::fromUtf8(inputText);
+    QTextStream in(&input);
+    FrameDevice outDevice(fd, "OUT"), errDevice(fd, "ERR");
+    QTextStream out(&outDevice), err(&errDevice);
+    program.setStreams(&in, &out, &err);
+    bool loaded = cached || loadProgramText(program, source);
+    bool parsed = loaded && program.parseAllStatements();
+    int status = !loaded ? 1 : !parsed ? 2 : 0;
+    qint64 parseUs = timer.nsecsElapsed() / 1000;
+    timer.start();
+    //execute() finds the statements parsed and only runs them
+    if(status == 0 && !program.execute()) status = 2;
+    qint64 runUs = timer.nsecsElapsed() / 1000;
+    out.flush();
+    err.flush();
+    program.setStreams(nullptr, nullptr, nullptr);
+
+    if(!parsed) cache.pop_front();//nothing worth keeping
+    while((int)cache.size() > cacheSize) cache.pop_back();
+    QByteArray end = "END " + QByteArray::number(status) + " " + QByteArray::number(cached ? 1 : 0) + " "
+            + QByteArray::number(parseUs) + " " + QByteArray::number(runUs) + "\n";
+    return !outDevice.isBroken() && !errDevice.isBroken() && writeAll(fd, end);
+}
+
+/*
+ * ConnectionQueue
+ * Accepted connections waiting for a worker, -1 tells a worker to stop.
+*/
+class ConnectionQueue
+{
+public:
+    void put(int fd)
+    {
+        QMutexLocker locker(&mutex);
+        connections.push_back(fd);
+        available.release();
+    }
+    int take()
+    {
+        available.acquire();
+        QMutexLocker locker(&mutex);
+        int fd = connections.front();
+        connections.pop_front();
+        return fd;
+    }
+private:
+    QMutex mutex;
+    QSemaphore available;
+    std::deque<int> connections;
+};
+
+int runServer(const QStringList& args)
+{
+    QString socketPath;
+    int workers = QThread::idealThreadCount();
+    int cacheSize = defaultCacheSize;
+    ExecutionLimits limits;
+    for(int i = 0; i < args.size(); i++){
+        if(args[i] == "--server" && i + 1 < args.size()) socketPath = args[++i];
+        else if(args[i] == "--workers" && i + 1 < args.size()) workers = args[++i].toInt();
+        else if(args[i] == "--cache" && i + 1 < args.size()) cacheSize = args[++i].toInt();
+        else if(parseLimitOption(args, i, limits)) continue;
+    }
+    QTextStream err(stderr);
+    if(socketPath.isEmpty() || workers < 1 || cacheSize < 1){
+        err << "Usage: qbasic-make --server <socket> [--workers <n>] [--cache <n>]\n"
+            << "           [--max-steps <n>] [--max-time-ms <n>] [--max-output-lines <n>] [--max-expr-memory <bytes>]\n"
+            << "           [--max-call-depth <n>]\n";
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    QByteArray name = socketPath.toLocal8Bit();
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(name.size() >= (int)sizeof(address.sun_path)){
+        err << "Socket path too long: " << socketPath << "\n";
+        return 1;
+    }
+    memcpy(address.sun_path, name.constData(), name.size());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(name.constData());//left by a server that was killed
+    if(listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0){
+        err << "Failed to listen on " << socketPath << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    err << "Listening on " << socketPath << " with " << workers << " workers\n";
+    err.flush();
+
+    ConnectionQueue queue;
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+    for(int i = 0; i < workers; i++){
+        pool.start([&queue, &limits, cacheSize] {
+            Worker worker(limits, cacheSize);
+            for(int fd = queue.take(); fd >= 0; fd = queue.take()) worker.serve(fd);
+        });
+    }
+    for(;;){
+        int fd = accept(listener, nullptr, nullptr);
+        if(fd >= 0) queue.put(fd);
+        else if(errno != EINTR && errno != ECONNABORTED) break;
+    }
+    err << "Failed to accept a connection: " << strerror(errno) << "\n";
+    for(int i = 0; i < workers; i++) queue.put(-1);//stop the workers once their connections end
+    close(listener);
+    return 1;
+}
+
+/*
+ * Response
+ * What the server answered to one request.
+*/
+struct Response
+{
+    int status = -1;
+    bool cached = false;
+    qint64 parseUs = 0;
+    qint64 runUs = 0;
+};
+
+/* readResponse
+* Read the frames of one response up to its END line. With echo the output
+* and the errors are written to stdout and stderr as they arrive.
+*/
+static bool readResponse(SocketReader& reader, Response& response, bool echo)
+{
+    QByteArray line, data;
+    while(reader.readLine(line)){
+        QList<QByteArray> fields = line.split(' ');
+        if(fields.size() == 5 && fields[0] == "END"){
+            response.status = fields[1].toInt();
+            response.cached = fields[2] == "1";
+            response.parseUs = fields[3].toLongLong();
+            response.runUs = fields[4].toLongLong();
+            return true;
+        }
+        if(fields.size() != 2 || (fields[0] != "OUT" && fields[0] != "ERR")) return false;
+        if(!reader.read(data, fields[1].toLongLong())) return false;
+        if(echo){
+            FILE* stream = fields[0] == "OUT" ? stdout : stderr;
+            fwrite(data.constData(), 1, data.size(), stream);
+            fflush(stream);
+        }
+    }
+    return false;
+}
+
+/* readFile
+* The bytes of filename, false if it can not be read.
+*/
+static bool readFile(const QString& filename, QByteArray& data)
+{
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly)) return false;
+    data = file.readAll();
+    return true;
+}
+
+int runClient(const QStringList& args)
+{
+    QString socketPath, programFile, inputFile;
+    int requests = 1, connections = 1;
+    for(int i = 0; i < args.size(); i++){
+        if(args[i] == "--client" && i + 2 < args.size()){
+            socketPath = args[++i];
+            programFile = args[++i];
+        }
+        else if(args[i] == "--input" && i + 1 < args.size()) inputFile = args[++i];
+        else if(args[i] == "--requests" && i + 1 < args.size()) requests = args[++i].toInt();
+        else if(args[i] == "--connections" && i + 1 < args.size()) connections = args[++i].toInt();
+    }
+    QTextStream err(stderr);
+    if(socketPath.isEmpty() || requests < 1 || connections < 1){
+        err << "Usage: qbasic-make --client <socket> <program> [--input <file>] [--requests <n>] [--connections <n>]\n";
+        return 1;
+    }
+    QByteArray programText, inputText;
+    if(!readFile(programFile, programText)){
+        err << "Failed to open file: " << programFile << "\n";
+        return 1;
+    }
+    if(!inputFile.isEmpty() && !readFile(inputFile, inputText)){
+        err << "Failed to open input file: " << inputFile << "\n";
+        return 1;
+    }
+    QByteArray request = "RUN " + QByteArray::number(programText.size()) + " "
+            + QByteArray::number(inputText.size()) + "\n" + programText + inputText;
+    signal(SIGPIPE, SIG_IGN);
+
+    if(requests == 1){
+        int fd = connectTo(socketPath);
+        if(fd < 0){
+            err << "Failed to connect to " << socketPath << "\n";
+            return 1;
+        }
+        SocketReader reader(fd);
+        Response response;
+        bool ok = writeAll(fd, request) && readResponse(reader, response, true);
+        close(fd);
+        if(!ok){
+            err << "The server closed the connection\n";
+            return 1;
+        }
+        return response.status;
+    }
+
+    //load test: the connections take the requests in turn
+    connections = std::min(connections, requests);
+    struct Connection
+    {
+        std::vector<qint64> latencyUs;
+        std::vector<Response> responses;
+        int failures = 0;
+    };
+    std::vector<Connection> results(connections);
+    std::atomic<int> nextRequest(0);
+    QSemaphore done;
+    QThreadPool pool;
+    pool.setMaxThreadCount(connections);
+    QElapsedTimer wall;
+    wall.start();
+    for(Connection& result : results){
+        pool.start([&, &result = result] {
+            int fd = connectTo(socketPath);
+            SocketReader reader(fd);
+            while(nextRequest++ < requests){
+                QElapsedTimer timer;
+                timer.start();
+                Response response;
+                if(fd < 0 || !writeAll(fd, request) || !readResponse(reader, response, false)){
+                    result.failures++;
+                    continue;
+                }
+                result.latencyUs.push_back(timer.nsecsElapsed() / 1000);
+                result.responses.push_back(response);
+            }
+            if(fd >= 0) close(fd);
+            done.release();
+        });
+    }
+    done.acquire(connections);
+    double seconds = wall.nsecsElapsed() / 1e9;
+
+    std::vector<qint64> latencies;
+    int failures = 0, failedRuns = 0, cachedRuns = 0;
+    qint64 parseUs = 0, runUs = 0;
+    for(const Connection& result : results){
+        latencies.insert(latencies.end(), result.latencyUs.begin(), result.latencyUs.end());
+        failures += result.failures;
+        for(const Response& response : result.responses){
+            failedRuns += response.status != 0;
+            cachedRuns += response.cached;
+            parseUs += response.parseUs;
+            runUs += response.runUs;
+        }
+    }
+    QTextStream out(stdout);
+    int answered = latencies.size();
+    out << requests << " requests over " << connections << " connections in "
+        << QString::number(seconds * 1000, 'f', 1) << " ms: "
+        << QString::number(answered / seconds, 'f', 0) << " requests/s\n";
+    if(answered > 0){
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](int p) { return latencies[std::min(answered - 1, answered * p / 100)]; };
+        out << "latency (us): p50 " << percentile(50) << ", p90 " << percentile(90)
+            << ", p99 " << percentile(99) << ", max " << latencies.back() << "\n";
+        out << "server (us per request): parse " << parseUs / answered << ", run " << runUs / answered
+            << "; " << cachedRuns << " cached, " << failedRuns << " failed runs\n";
+    }
+    if(failures > 0) out << failures << " requests got no answer\n";
+    return failures > 0 ? 1 : 0;
+}
+
+#else
+
+int runServer(const QStringList&)
+{
+    QTextStream(stderr) << "The execution server needs Unix domain sockets\n";
+    return 1;
+}
+
+int runClient(const QStringList&)
+{
+    QTextStream(stderr) << "The execution server needs Unix domain sockets\n";
+    return 1;
+}
+
+#endif
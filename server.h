@@ -0,0 +1,35 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <QStringList>
+
+/*
+ * Execution server: runs programs sent over a Unix domain socket, so that a
+ * job costs one request instead of starting the application.
+ * Usage:
+ *   qbasic-make --server <socket> [--workers <n>] [--cache <n>] [--max-steps <n> ...]
+ *   qbasic-make --client <socket> <program> [--input <file>]
+ *                        [--requests <n>] [--connections <n>]
+ * The server starts --workers threads (one per core by default) when it
+ * starts. Each keeps the last --cache programs it ran loaded and parsed, so
+ * a program sent again with the same text only runs. A connection is served
+ * by one worker until it is closed. The --max-* options limit every run,
+ * as in the headless runner.
+ * The client sends a program file and its input. With one request it prints
+ * the output and the errors as they arrive; with more, sent over
+ * --connections connections at once, it prints latency and throughput.
+ *
+ * Protocol, repeated any number of times on a connection:
+ *   request:  "RUN <program bytes> <input bytes>\n" <program> <input>
+ *             program: "<line> <statement>" lines, input: one value per line
+ *   response: "OUT <n>\n" <n bytes of output> and "ERR <n>\n" <n bytes of
+ *             error messages>, as the run produces them, then
+ *             "END <status> <cached> <parse us> <run us>\n"
+ *             status: 0 ok, 1 the program could not be loaded, 2 it failed;
+ *             cached: 1 if the worker reused the parsed program.
+ * All text is UTF-8. Unix only.
+*/
+int runServer(const QStringList& args);
+int runClient(const QStringList& args);
+
+#endif // SERVER_H
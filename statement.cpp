@@ -1,87 +1,221 @@
 #include "statement.h"
 #include "program.h"
 #include "expression.h"
+#include "metrics.h"
+#include "lexicon.h"
 #include <QDebug>
 #include <QRegularExpression>
 
-Statement::Statement(Program* parent)
+/* findWord
+* Index of word in s, from index from on, where it is not part of a
+* longer name. -1 if there is none.
+*/
+static int findWord(const QString& s, const QString& word, int from = 0)
+{
+    auto isNameChar = [](QChar c){ return c.isLetterOrNumber() || c == '_'; };
+    for(int i = s.indexOf(word, from); i != -1; i = s.indexOf(word, i + 1)){
+        int end = i + word.size();
+        if((i == 0 || !isNameChar(s[i - 1])) && (end == s.size() || !isNameChar(s[end]))) return i;
+    }
+    return -1;
+}
+
+Statement::Statement(Program* parent, int line)
 {
     this->parent = parent;
+    this->line = line;
+    sourceOffset = 0;
+    sourceLength = 0;
+    type = StatementType::unknownStmt;
+    condOpt = 0;
+    target = 0;
+    jumpLine = 0;
+    varSlot = -1;
+    for(auto& exp : expressions) exp = nullptr;
+    dirty = true;
+    planIndex = -1;
+    jumpIndex = -1;
+}
+
+Statement::Statement(Statement&& other) noexcept : Statement(other.parent, other.line)
+{
+    *this = std::move(other);
+}
+
+/* Statement::operator=
+* Move by swapping, so that the old content of this statement is released
+* when other is destroyed. StatementTable relies on this when it shifts
+* statements around.
+*/
+Statement& Statement::operator=(Statement&& other) noexcept
+{
+    std::swap(parent, other.parent);
+    std::swap(line, other.line);
+    std::swap(sourceOffset, other.sourceOffset);
+    std::swap(sourceLength, other.sourceLength);
+    std::swap(type, other.type);
+    std::swap(condOpt, other.condOpt);
+    std::swap(target, other.target);
+    std::swap(jumpLine, other.jumpLine);
+    std::swap(varSlot, other.varSlot);
+    std::swap(expressions, other.expressions);
+    std::swap(dirty, other.dirty);
+    std::swap(planIndex, other.planIndex);
+    std::swap(jumpIndex, other.jumpIndex);
+    return *this;
 }
 
 void Statement::setStatement(const QString& s)
 {
-    this->s = s;
+    parent->storeSource(*this, s);
+    dirty = true;
     //parse();
 }
 
-QString Statement::getStatement()
+QString Statement::getStatement() const
+{
+    return parent->source.mid(sourceOffset, sourceLength);
+}
+
+/* Statement::hasText
+* True if s is the text of the statement, compared in place.
+*/
+bool Statement::hasText(const QString& s) const
 {
-    return s;
+    return s.size() == sourceLength && QStringView(parent->source).mid(sourceOffset, sourceLength).compare(s) == 0;
+}
+
+/* Statement::clearParsed
+* Drop the parsed form of the statement.
+*/
+void Statement::clearParsed()
+{
+    for(auto& exp : expressions){
+        delete exp;
+        exp = nullptr;
+    }
+    type = StatementType::unknownStmt;
+    varSlot = -1;
+    condOpt = 0;
+    target = 0;
+    jumpLine = 0;
 }
 
 /*
  * Statement::parse
  * Parse the statement into a tree.
+ * The parsed form (type, variable, jump target and expressions) is kept
+ * so that execute() does not need to parse the statement again.
+ * A syntax error is reported in status and leaves the statement unknown
+ * and dirty, so that the next parse of the program tries it again.
 */
-void Statement::parse(){
+void Statement::parse(Status& status){
     //clear old data
-    for(auto exp : expressions){
-        delete exp;
-    }
-    expressions.clear();
-    statementTree = "";
+    clearParsed();
+    METRIC_INC(statementParses);
     
     //split the command into two parts,seperated by the first space
     //store in argv0 and argv1.
-    QString trimmed = s.trimmed();
+    QString trimmed = getStatement().trimmed();
     int firstSpaceIndex = trimmed.indexOf(' ');
     QString argv0,argv1;
     argv0 = trimmed.left(firstSpaceIndex);
     if(firstSpaceIndex != -1) argv1 = trimmed.mid(firstSpaceIndex + 1).trimmed();
     else argv1 = "";
 
-    if(QString::compare(argv0,"PRINT") == 0){
-        Expression* evaluator = new Expression(argv1,parent);
-        expressions.push_back(evaluator);
-        statementTree = "PRINT\n" + evaluator->getExpressionTree();
-        pc = 0;
-    }
-    else if(QString::compare(argv0,"INPUT") == 0){
-        if(!parent->isValidVariableName(argv1))
-            throw std::invalid_argument("Invalid variable name: " + argv1.toStdString());
-        statementTree = "INPUT\n    " + argv1;
-        pc = 0;
-    }
-    else if(QString::compare(argv0,"LET") == 0){    
+    StatementType parsed = StatementType::unknownStmt;
+    switch(keywordOf(argv0)){
+    case printKw:
+        expressions[0] = new Expression(argv1,parent,status);
+        METRIC_INC(parserAllocations);
+        parsed = StatementType::printStmt;
+        break;
+    case inputKw:
+        if(!parent->isValidVariableName(argv1)){
+            status.fail(ErrorCode::invalidVariableName, argv1);
+            return;
+        }
+        varSlot = parent->slotOf(argv1);
+        parsed = StatementType::inputStmt;
+        break;
+    case letKw:{
         int equalIndex = argv1.indexOf('=');
         if (equalIndex == -1) {
-            throw std::invalid_argument("Error: Invalid LET statement format: = not found.");
+            status.fail(ErrorCode::invalidFormat, "LET statement format: = not found.");
+            return;
         }
 
         QString varName = argv1.left(equalIndex).trimmed();
         QString expression = argv1.mid(equalIndex + 1).trimmed();
-        if(!parent->isValidVariableName(varName)) 
-            throw std::invalid_argument("Invalid variable name: " + varName.toStdString());
-        Expression* evaluator = new Expression(expression,parent);
-        expressions.push_back(evaluator);
-
-        statementTree = "LET =\n    " + varName + "\n" + evaluator->getExpressionTree();
-        pc = 0;
+        if(varName.endsWith(')')){
+            //LET a(i) = ...: the target is an element expression
+            expressions[1] = new Expression(varName,parent,status);
+            METRIC_INC(parserAllocations);
+            if(status.ok() && !expressions[1]->isElement()) status.fail(ErrorCode::invalidVariableName, varName);
+            if(!status.ok()) return;
+        }
+        else if(!parent->isValidVariableName(varName)){
+            status.fail(ErrorCode::invalidVariableName, varName);
+            return;
+        }
+        expressions[0] = new Expression(expression,parent,status);
+        METRIC_INC(parserAllocations);
+        if(expressions[1] == nullptr) varSlot = parent->slotOf(varName);
+        parsed = StatementType::letStmt;
+        break;
+    }
+    case dimKw:{
+        //DIM a(n): an array of n elements, a(0) ... a(n - 1)
+        int bracketIndex = argv1.indexOf('(');
+        if (bracketIndex == -1 || !argv1.endsWith(')')){
+            status.fail(ErrorCode::invalidFormat, "DIM statement format: DIM name(size) expected.");
+            return;
+        }
+        QString arrayName = argv1.left(bracketIndex).trimmed();
+        QString size = argv1.mid(bracketIndex + 1, argv1.size() - bracketIndex - 2);
+        if(!parent->isValidVariableName(arrayName)){
+            status.fail(ErrorCode::invalidVariableName, arrayName);
+            return;
+        }
+        expressions[0] = new Expression(size,parent,status);
+        METRIC_INC(parserAllocations);
+        varSlot = parent->slotOf(arrayName);
+        parsed = StatementType::dimStmt;
+        break;
     }
-    else if(QString::compare(argv0,"GOTO") == 0){
+    case gotoKw:{
         bool ok;
         int lineNumber = argv1.toInt(&ok);
-        if (ok) {
-            pc = lineNumber;
-            statementTree = "GOTO\n    " + QString::number(lineNumber)+"\n";
+        if (ok && lineNumber > 0) {
+            target = lineNumber;
+            jumpLine = lineNumber;
+            parsed = StatementType::gotoStmt;
         } else {
-            throw std::invalid_argument("Error: Invalid GOTO statement format: invalid line number.");
+            status.fail(ErrorCode::invalidFormat, "GOTO statement format: invalid line number.");
+        }
+        break;
+    }
+    case gosubKw:{
+        bool ok;
+        int lineNumber = argv1.toInt(&ok);
+        if (!ok || lineNumber <= 0){
+            status.fail(ErrorCode::invalidFormat, "GOSUB statement format: invalid line number.");
+            return;
         }
+        target = lineNumber;
+        jumpLine = lineNumber;
+        parsed = StatementType::gosubStmt;
+        break;
     }
-    else if(QString::compare(argv0,"IF") == 0){
+    case returnKw:
+        parsed = StatementType::returnStmt;
+        break;
+    case ifKw:{
         int thenIndex = argv1.indexOf("THEN");
-        if (thenIndex == -1) throw std::invalid_argument("Error: Invalid IF statement format: THEN not found.");
+        if (thenIndex == -1){
+            status.fail(ErrorCode::invalidFormat, "IF statement format: THEN not found.");
+            return;
+        }
 
         //Split the condition and the line number
         QString condition = argv1.left(thenIndex).trimmed();
@@ -89,144 +223,328 @@ void Statement::parse(){
 
         //Split the condition into two parts ,seperated by '=' or '>' or '<',and mark the operator
         int optIndex = condition.indexOf(QRegularExpression("[><=]"));
-        if(optIndex == -1) throw std::invalid_argument("Error: Invalid IF statement format: operator not found.");
+        if(optIndex == -1){
+            status.fail(ErrorCode::invalidFormat, "IF statement format: operator not found.");
+            return;
+        }
         QString exp1 = condition.left(optIndex);
         QString exp2 = condition.mid(optIndex + 1).trimmed();
         QString opt = condition.mid(optIndex, 1);
 
-        Expression* evaluator1 = new Expression(exp1,parent);
-        Expression* evaluator2 = new Expression(exp2,parent);
-        expressions.push_back(evaluator1);
-        expressions.push_back(evaluator2);
-        statementTree = "IF THEN\n" + evaluator1->getExpressionTree() + "    " + opt + "\n" + evaluator2->getExpressionTree() + "    " + lineNumberStr+"\n";
-        pc = 0;
+        bool ok;
+        int lineNumber = lineNumberStr.toInt(&ok);
+        if (!ok || lineNumber <= 0){
+            status.fail(ErrorCode::invalidFormat, "IF statement format: invalid line number.");
+            return;
+        }
+
+        expressions[0] = new Expression(exp1,parent,status);
+        if(!status.ok()) return;
+        expressions[1] = new Expression(exp2,parent,status);
+        METRIC_ADD(parserAllocations, 2);
+        condOpt = opt[0].toLatin1();
+        target = lineNumber;
+        jumpLine = lineNumber;
+        parsed = StatementType::ifStmt;
+        break;
     }
-    else if(QString::compare(argv0,"END") == 0){
-        //END statement:return -2
-        statementTree = "END\n";
-        pc = -2;
+    case forKw:{
+        //FOR v = start TO limit [STEP step]
+        int equalIndex = argv1.indexOf('=');
+        if (equalIndex == -1){
+            status.fail(ErrorCode::invalidFormat, "FOR statement format: = not found.");
+            return;
+        }
+        QString varName = argv1.left(equalIndex).trimmed();
+        int toIndex = findWord(argv1, "TO", equalIndex + 1);
+        if (toIndex == -1){
+            status.fail(ErrorCode::invalidFormat, "FOR statement format: TO not found.");
+            return;
+        }
+        int stepIndex = findWord(argv1, "STEP", toIndex + 2);
+        if(!parent->isValidVariableName(varName)){
+            status.fail(ErrorCode::invalidVariableName, varName);
+            return;
+        }
+        expressions[0] = new Expression(argv1.mid(equalIndex + 1, toIndex - equalIndex - 1).trimmed(),parent,status);
+        if(!status.ok()) return;
+        if(stepIndex == -1) expressions[1] = new Expression(argv1.mid(toIndex + 2).trimmed(),parent,status);
+        else{
+            expressions[1] = new Expression(argv1.mid(toIndex + 2, stepIndex - toIndex - 2).trimmed(),parent,status);
+            if(!status.ok()) return;
+            expressions[2] = new Expression(argv1.mid(stepIndex + 4).trimmed(),parent,status);
+        }
+        METRIC_ADD(parserAllocations, stepIndex == -1 ? 2 : 3);
+        varSlot = parent->slotOf(varName);
+        parsed = StatementType::forStmt;
+        break;
     }
-    else if(QString::compare(argv0,"REM") == 0){
+    case nextKw:
+        //NEXT [v]: without a variable, the innermost loop
+        if(!argv1.isEmpty()){
+            if(!parent->isValidVariableName(argv1)){
+                status.fail(ErrorCode::invalidVariableName, argv1);
+                return;
+            }
+            varSlot = parent->slotOf(argv1);
+        }
+        parsed = StatementType::nextStmt;
+        break;
+    case endKw:
+        //END statement:return -2
+        parsed = StatementType::endStmt;
+        break;
+    case remKw:
         //REM: do nothing
-        statementTree = "REM\n    " + argv1 + "\n";
-        pc = 0;
+        parsed = StatementType::remStmt;
+        break;
+    default:
+        break;
     }
-    pc = 0;
+    if(status.ok()) type = parsed;
+    dirty = !status.ok();
 }
 
 /* Statement::execute.
-* Execute the statement.
-* Return -1 if the statement execution failed.(Actually, this should not happen.)
+* Execute the parsed statement. parse() must have been called before.
+* Return -1 if the statement execution failed, with the error in status.
 * Return -2 if the statement touches the END statement.
+* Return -3 for RETURN: continue after the GOSUB of the innermost call.
 * Return 0 if the next statement index is not set.
 * If the next statement is set, return the next statement index.
 */
-int Statement::execute()
+int Statement::execute(Status& status)
 {
-    //split the command into two parts,seperated by the first space
-    //store in argv0 and argv1.
-    QString trimmed = s.trimmed();
-    int firstSpaceIndex = trimmed.indexOf(' ');
-    QString argv0,argv1;
-    argv0 = trimmed.left(firstSpaceIndex);
-    if(firstSpaceIndex != -1) argv1 = trimmed.mid(firstSpaceIndex + 1).trimmed();
-    else argv1 = "";
-
-    if(QString::compare(argv0,"PRINT") == 0){
-        Expression evaluator(argv1,parent);
-        int result = evaluator.evaluate();
-        parent->output(QString::number(result));
+    switch(type){
+    case StatementType::printStmt:{
+        int result = expressions[0]->evaluate(status);
+        if(!status.ok()) return -1;
+        parent->output(QString::number(result), status);
         //qDebug() << result;
-        return 0;
+        break;
     }
-    else if(QString::compare(argv0,"INPUT") == 0){
-        //TODO: implement INPUT statement
-        parent->input(argv1);
-        return 0;
+    case StatementType::inputStmt:
+        parent->input(varSlot, status);
+        break;
+    case StatementType::letStmt:{
+        int result = expressions[0]->evaluate(status);
+        if(!status.ok()) return -1;
+        if(expressions[1] != nullptr) expressions[1]->store(result, status);
+        else{
+            parent->setVariable(varSlot, result, status);
+            METRIC_INC(variableWrites);
+        }
+        break;
     }
-    else if(QString::compare(argv0,"LET") == 0){    
-        int equalIndex = argv1.indexOf('=');
-        if (equalIndex == -1) {
-            throw std::invalid_argument("Error: Invalid LET statement format: = not found.");
+    case StatementType::dimStmt:{
+        int size = expressions[0]->evaluate(status);
+        if(!status.ok()) return -1;
+        parent->dimArray(varSlot, size, status);
+        break;
+    }
+    case StatementType::forStmt:{
+        //the limit and the step are evaluated once, when the loop is entered
+        if(target == 0){
+            status.fail(ErrorCode::forWithoutNext);
+            return -1;
         }
-        QString varName = argv1.left(equalIndex).trimmed();
-        QString expression = argv1.mid(equalIndex + 1).trimmed();
-
-        Expression evaluator(expression,parent);
-        int result = evaluator.evaluate();
-        if(!parent->isValidVariableName(varName)) 
-            throw std::invalid_argument("Invalid variable name: " + varName.toStdString());
-        parent->variables[varName] = result;
-        return 0;
+        int start = expressions[0]->evaluate(status);
+        int limit = status.ok() ? expressions[1]->evaluate(status) : 0;
+        int step = status.ok() && expressions[2] != nullptr ? expressions[2]->evaluate(status) : 1;
+        if(!status.ok()) return -1;
+        parent->setVariable(varSlot, start, status);
+        METRIC_INC(variableWrites);
+        if(!status.ok()) return -1;
+        if(parent->enterLoop(line, varSlot, limit, step, status)) return 0;
+        if(!status.ok()) return -1;
+        //no iteration: continue after the NEXT (or end with it)
+        return jumpLine > 0 ? jumpLine : -2;
     }
-    else if(QString::compare(argv0,"GOTO") == 0){
-        bool ok;
-        int lineNumber = argv1.toInt(&ok);
-        if (ok) {
-            return lineNumber;
-        } else {
-            throw std::invalid_argument("Error: Invalid GOTO statement format: invalid line number.");
+    case StatementType::nextStmt:{
+        if(target == 0){
+            status.fail(ErrorCode::nextWithoutFor);
+            return -1;
         }
+        METRIC_INC(variableWrites);
+        bool again = parent->nextIteration(target, status);
+        if(!status.ok()) return -1;
+        return again ? jumpLine : 0;
     }
-    else if(QString::compare(argv0,"IF") == 0){
-        int thenIndex = argv1.indexOf("THEN");
-        if (thenIndex == -1) throw std::invalid_argument("Error: Invalid IF statement format: THEN not found.");
-
-        //Split the condition and the line number
-        QString condition = argv1.left(thenIndex).trimmed();
-        QString lineNumberStr = argv1.mid(thenIndex + 4).trimmed();
-
-        //Split the condition into two parts ,seperated by '=' or '>' or '<',and mark the operator
-        int optIndex = condition.indexOf(QRegularExpression("[><=]"));
-        if(optIndex == -1) throw std::invalid_argument("Error: Invalid IF statement format: operator not found.");
-        QString exp1 = condition.left(optIndex);
-        QString exp2 = condition.mid(optIndex + 1).trimmed();
-        QString opt = condition.mid(optIndex, 1);
-
-        if (judgeCondition(exp1,exp2,opt)) {
-            bool ok;
-            int lineNumber = lineNumberStr.toInt(&ok);
-            if (ok) {
-                return lineNumber;
-            } else {
-                throw std::invalid_argument("Error: Invalid IF statement format: invalid line number.");
-            }
+    case StatementType::gotoStmt:
+        METRIC_INC(gotoJumps);
+        return jumpLine;
+    case StatementType::gosubStmt:
+        //the statement after the GOSUB is always the next entry of the plan
+        METRIC_INC(gosubCalls);
+        parent->callSubroutine(line, planIndex + 1, status);
+        return status.ok() ? jumpLine : -1;
+    case StatementType::returnStmt:
+        //RETURN: return -3, Program pops the return address
+        return -3;
+    case StatementType::ifStmt:{
+        bool taken = judgeCondition(status);
+        if(!status.ok()) return -1;
+        if (taken) {
+            METRIC_INC(ifJumps);
+            return jumpLine;
         }
         return 0;
     }
-    else if(QString::compare(argv0,"END") == 0){
+    case StatementType::endStmt:
         //END statement:return -2
         return -2;
-    }
-    else if(QString::compare(argv0,"REM") == 0){
+    case StatementType::remStmt:
         //REM: do nothing
         return 0;
+    default:
+        return 0;
     }
-    return 0;
+    return status.ok() ? 0 : -1;
 }
 
-bool Statement::judgeCondition(const QString& exp1, const QString& exp2, const QString& opt)
+bool Statement::judgeCondition(Status& status)
 {
     //implement condition judgment
-    Expression evaluator1(exp1,parent);
-    Expression evaluator2(exp2,parent);
-    int value1 = evaluator1.evaluate();
-    int value2 = evaluator2.evaluate();
-    if(opt == "=") return value1 == value2;
-    else if(opt == ">") return value1 > value2;
-    else if(opt == "<") return value1 < value2;
-    else throw std::invalid_argument("Invalid operator");
+    int value1 = expressions[0]->evaluate(status);
+    if(!status.ok()) return false;
+    int value2 = expressions[1]->evaluate(status);
+    if(!status.ok()) return false;
+    if(condOpt == '=') return value1 == value2;
+    else if(condOpt == '>') return value1 > value2;
+    else if(condOpt == '<') return value1 < value2;
+    status.fail(ErrorCode::invalidOperator);
     return false;
 }
 
+/* Statement::isJump
+* True for the statements that may continue at jumpLine instead of the
+* next line: GOTO, IF, FOR (no iteration), NEXT (next iteration) and GOSUB.
+* RETURN continues at a line only known when it is executed.
+*/
+bool Statement::isJump() const
+{
+    return type == StatementType::gotoStmt || type == StatementType::ifStmt
+            || type == StatementType::forStmt || type == StatementType::nextStmt
+            || type == StatementType::gosubStmt;
+}
+
+/* Statement::getNodeCount
+* Number of expression tree nodes held by the parsed statement.
+*/
+int Statement::getNodeCount() const
+{
+    int count = 0;
+    for(auto exp : expressions) if(exp) count += exp->getNodeCount();
+    return count;
+}
+
+/* Statement::getTapeBytes
+* Bytes of the expression tapes held by the parsed statement.
+*/
+qint64 Statement::getTapeBytes() const
+{
+    qint64 bytes = 0;
+    for(auto exp : expressions) if(exp) bytes += exp->getTapeBytes();
+    return bytes;
+}
+
+/* Statement::getStatementTree
+* Render the syntax tree of the parsed statement.
+*/
 QString Statement::getStatementTree(){
-    return statementTree;
+    switch(type){
+    case StatementType::printStmt:
+        return "PRINT\n" + expressions[0]->getExpressionTree();
+    case StatementType::inputStmt:
+        return "INPUT\n    " + *parent->variables[varSlot].name;
+    case StatementType::letStmt:
+        if(expressions[1] != nullptr)
+            return "LET =\n" + expressions[1]->getExpressionTree() + expressions[0]->getExpressionTree();
+        return "LET =\n    " + *parent->variables[varSlot].name + "\n" + expressions[0]->getExpressionTree();
+    case StatementType::dimStmt:
+        return "DIM\n    " + *parent->variables[varSlot].name + "\n" + expressions[0]->getExpressionTree();
+    case StatementType::forStmt:
+        return "FOR\n    " + *parent->variables[varSlot].name + "\n" + expressions[0]->getExpressionTree()
+                + expressions[1]->getExpressionTree() + (expressions[2] ? expressions[2]->getExpressionTree() : "");
+    case StatementType::nextStmt:
+        return "NEXT\n" + (varSlot >= 0 ? "    " + *parent->variables[varSlot].name + "\n" : QString());
+    case StatementType::gotoStmt:
+        return "GOTO\n    " + QString::number(target) + "\n";
+    case StatementType::gosubStmt:
+        return "GOSUB\n    " + QString::number(target) + "\n";
+    case StatementType::returnStmt:
+        return "RETURN\n";
+    case StatementType::ifStmt:
+        return "IF THEN\n" + expressions[0]->getExpressionTree() + "    " + QChar(condOpt) + "\n"
+                + expressions[1]->getExpressionTree() + "    " + QString::number(target) + "\n";
+    case StatementType::endStmt:
+        return "END\n";
+    case StatementType::remStmt:
+        return "REM\n    " + getStatement().trimmed().mid(3).trimmed() + "\n";
+    default:
+        return "";
+    }
 }
 
 Statement::~Statement(){
-    for(auto exp : expressions){
-        delete exp;
+    clearParsed();
+    if(sourceLength > 0) parent->releaseSource(sourceLength);
+}
+
+/*
+ * StatementTable
+*/
+
+/* StatementTable::lowerBound
+* Index of the first statement whose line is not less than line.
+*/
+int StatementTable::lowerBound(int line) const
+{
+    int lo = 0, hi = statements.size();
+    while(lo < hi){
+        int mid = (lo + hi) / 2;
+        if(statements[mid].line < line) lo = mid + 1;
+        else hi = mid;
     }
-    expressions.clear();
+    return lo;
+}
+
+/* StatementTable::indexOf
+* Index of the statement on line, -1 if there is none.
+*/
+int StatementTable::indexOf(int line) const
+{
+    int index = lowerBound(line);
+    if(index < (int)statements.size() && statements[index].line == line) return index;
+    return -1;
+}
+
+Statement* StatementTable::find(int line)
+{
+    int index = indexOf(line);
+    return index < 0 ? nullptr : &statements[index];
 }
 
+/* StatementTable::insert
+* Return the statement on line, creating an empty one if there is none.
+* Pointers to statements are invalidated when a new one is created.
+*/
+Statement* StatementTable::insert(int line, Program* parent)
+{
+    int index = lowerBound(line);
+    if(index < (int)statements.size() && statements[index].line == line) return &statements[index];
+    if(index == (int)statements.size()) statements.emplace_back(parent, line);
+    else statements.emplace(statements.begin() + index, parent, line);
+    return &statements[index];
+}
+
+/* StatementTable::erase
+* Delete the statement on line. Return false if there is none.
+*/
+bool StatementTable::erase(int line)
+{
+    int index = indexOf(line);
+    if(index < 0) return false;
+    statements.erase(statements.begin() + index);
+    return true;
+}
@@ -2,27 +2,104 @@
 #define STATEMENT_H
 
 #include <QString>
+#include <vector>
 #include "expression.h"
+#include "status.h"
 
 class Program;
 
+enum StatementType : unsigned char{
+    unknownStmt,
+    printStmt,
+    inputStmt,
+    letStmt,
+    gotoStmt,
+    ifStmt,
+    endStmt,
+    remStmt,
+    dimStmt,
+    forStmt,
+    nextStmt,
+    gosubStmt,
+    returnStmt,
+};
+
 class Statement
 {
+public:
+    static const int maxExpressions = 3;
 private:
     Program* parent;
-    QString s;
-    QString statementTree;
-    int pc;
-    QVector<Expression*> expressions;
+    int line;
+/* The text of the statement lives in the program's shared source buffer.*/
+    int sourceOffset;
+    int sourceLength;
+/* Parsed form, filled by parse() and used by execute().
+ * The syntax tree is rendered from it on demand.*/
+    StatementType type;
+    char condOpt;//comparison operator of IF
+    int target;//jump target line of GOTO, IF and GOSUB, as written; line of the matching NEXT or FOR
+    int jumpLine;//jump target after threading (see ControlFlowGraph)
+    int varSlot;//variable slot of the target of LET and INPUT, the array of DIM, the counter of FOR and NEXT
+    Expression* expressions[maxExpressions];
+    bool dirty;//the text changed, or failed to parse, since the last parse
+/* Position in the execution plan of the program.*/
+    int planIndex;
+    int jumpIndex;
+    void clearParsed();
 public:
-    Statement(Program* parent);
+    Statement(Program* parent, int line = 0);
+    Statement(Statement&& other) noexcept;
+    Statement& operator=(Statement&& other) noexcept;
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
     ~Statement();
-    QString getStatement();
+    QString getStatement() const;
+    bool hasText(const QString& s) const;
     QString getStatementTree();
     void setStatement(const QString& s);
-    void parse();
-    int execute();
-    bool judgeCondition(const QString& exp1, const QString& exp2, const QString& opt);
+    void parse(Status& status);
+    int execute(Status& status);
+    bool judgeCondition(Status& status);
+    int getLine() const { return line; }
+    StatementType getType() const { return type; }
+    bool isJump() const;//may continue at jumpLine instead of the next line
+    int getTarget() const { return target; }
+    int getNodeCount() const;
+    qint64 getTapeBytes() const;
+
+friend class Program;
+friend class ControlFlowGraph;
+friend class StatementTable;
+friend class Lockstep;
+};
 
+/*
+ * StatementTable
+ * The statements of a program, stored by value in one vector sorted by
+ * line number. Lookups are binary searches over contiguous memory and
+ * loading a program in line order only appends.
+*/
+class StatementTable
+{
+public:
+    typedef std::vector<Statement>::iterator iterator;
+    iterator begin() { return statements.begin(); }
+    iterator end() { return statements.end(); }
+    bool empty() const { return statements.empty(); }
+    int size() const { return statements.size(); }
+    Statement& operator[](int index) { return statements[index]; }
+    int indexOf(int line) const;
+    Statement* find(int line);
+    Statement* insert(int line, Program* parent);
+    bool erase(int line);
+    void clear() { statements.clear(); }
+    void shrink() { statements.shrink_to_fit(); }
+    void reserve(int n) { statements.reserve(n); }
+    size_t getBytesReserved() const { return statements.capacity() * sizeof(Statement); }
+
+private:
+    std::vector<Statement> statements;
+    int lowerBound(int line) const;
 };
 #endif // STATEMENT_H
@@ -0,0 +1,46 @@
+#include "status.h"
+
+/* Status::fail
+* Record an error. The line is set by the caller that knows it.
+*/
+void Status::fail(ErrorCode code, const QString& subject, long long number)
+{
+    this->code = code;
+    this->subject = subject;
+    this->number = number;
+}
+
+/* Status::message
+* The text of the error, without its line. Empty if ok.
+*/
+QString Status::message() const
+{
+    QString n = QString::number(number);
+    switch(code){
+    case ErrorCode::none: return QString();
+    case ErrorCode::invalidCharacter: return "Invalid character: " + subject;
+    case ErrorCode::invalidExpression: return "Invalid expression";
+    case ErrorCode::bracketExpected: return "Invalid expression: ) expected";
+    case ErrorCode::invalidFormat: return "Error: Invalid " + subject;
+    case ErrorCode::invalidVariableName: return "Invalid variable name: " + subject;
+    case ErrorCode::variableNotFound: return "Variable not found: " + subject;
+    case ErrorCode::arrayAsVariable: return "Array used as a variable: " + subject;
+    case ErrorCode::arrayNotDimensioned: return "Array not dimensioned: " + subject;
+    case ErrorCode::indexOutOfRange: return "Index out of range: " + subject + "(" + n + ")";
+    case ErrorCode::invalidArraySize: return "Invalid array size: " + subject + "(" + n + ")";
+    case ErrorCode::divisionByZero: return "Division by zero";
+    case ErrorCode::invalidOperator: return "Invalid operator";
+    case ErrorCode::noInputLeft: return "No input left for variable: " + subject;
+    case ErrorCode::invalidInput: return "The input is not a valid integer: " + subject;
+    case ErrorCode::forWithoutNext: return "FOR without NEXT";
+    case ErrorCode::nextWithoutFor: return "NEXT without FOR";
+    case ErrorCode::returnWithoutGosub: return "RETURN without GOSUB";
+    case ErrorCode::tooManyLoops: return "Too many nested FOR loops (more than " + n + ")";
+    case ErrorCode::tooManyCalls: return "Too many nested GOSUB calls (more than " + n + ")";
+    case ErrorCode::stepLimit: return "Execution limit exceeded: more than " + n + " statements executed";
+    case ErrorCode::timeLimit: return "Execution limit exceeded: running for more than " + n + " ms";
+    case ErrorCode::outputLimit: return "Execution limit exceeded: more than " + n + " output lines";
+    case ErrorCode::memoryLimit: return "Execution limit exceeded: expression trees need more than " + n + " bytes";
+    }
+    return QString();
+}
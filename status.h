@@ -0,0 +1,63 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <QString>
+
+enum class ErrorCode : unsigned char{
+    none,
+    //syntax errors
+    invalidCharacter,//subject: the character
+    invalidExpression,
+    bracketExpected,
+    invalidFormat,//subject: what is wrong, "LET statement format: = not found."
+    invalidVariableName,//subject: the name
+    //run time errors, subject: the variable
+    variableNotFound,
+    arrayAsVariable,
+    arrayNotDimensioned,
+    indexOutOfRange,//number: the index
+    invalidArraySize,//number: the size
+    divisionByZero,
+    invalidOperator,
+    noInputLeft,
+    invalidInput,//subject: the input line
+    forWithoutNext,
+    nextWithoutFor,
+    returnWithoutGosub,
+    tooManyLoops,//number: the depth limit
+    tooManyCalls,
+    //limits of a run, number: the limit
+    stepLimit,
+    timeLimit,
+    outputLimit,
+    memoryLimit,
+};
+
+/*
+ * Status
+ * Outcome of tokenizing, parsing and executing: ok, or the code of an
+ * error with what its message needs and the line it happened on.
+ * The message is only formatted when it is shown. Functions that may fail
+ * take a Status& and return a plain value; they report the error with
+ * fail() and the caller checks ok() before using the value.
+ * Exceptions are left to the UI boundary (Program).
+*/
+class Status
+{
+public:
+    Status() = default;
+    bool ok() const { return code == ErrorCode::none; }
+    void fail(ErrorCode code, const QString& subject = QString(), long long number = 0);//out of line: the error path stays cold
+    ErrorCode getCode() const { return code; }
+    int getLine() const { return line; }
+    void setLine(int line) { if(this->line == 0) this->line = line; }//the innermost line wins
+    QString message() const;
+
+private:
+    ErrorCode code = ErrorCode::none;
+    int line = 0;
+    long long number = 0;
+    QString subject;
+};
+
+#endif // STATUS_H
@@ -1,4 +1,7 @@
 #include "tokenizer.h"
+#include "metrics.h"
+#include "scanner.h"
+#include "lexicon.h"
 #include <QDebug>
 
 /*
@@ -17,26 +20,33 @@ QChar Tokenizer::nextChar(int pos) {
 }
 
 bool Tokenizer::isOperator(QChar c) {
-    return c == '+' || c == '-' || c == '*' || c == '/' ;
+    return isCharClass(c, operatorChar);
 }
 
 //skipBlank:return the first non-blank character after pos
+//ASCII blanks are skipped by the scanner, other unicode spaces one by one.
 int Tokenizer::skipBlank(int pos) {
+    pos = Scanner::skipBlanks(s.constData(), pos, s.size());
     while (pos<s.size() && currentChar(pos).isSpace()) {
-        pos++;
+        pos = Scanner::skipBlanks(s.constData(), pos + 1, s.size());
     }
     return pos;
 }
 
 bool Tokenizer::isDigit(QChar c){
-    return c >= '0' && c <= '9';
+    return isCharClass(c, digitChar);
 }
 
 bool Tokenizer::isLetter(QChar c){
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    return isCharClass(c, letterChar);
 }
 
-void Tokenizer::tokenize(QVector<Token>& tokens){
+/* Tokenizer::tokenize
+* Append the tokens of the text to tokens, stop at the first character
+* that starts no token and report it in status.
+*/
+void Tokenizer::tokenize(QVector<Token>& tokens, Status& status){
+    METRIC_INC(tokenizations);
     int p=0,pz=0;
     for(;p < s.size();){
         //qDebug() << "p: " << p << "s[p]: " << s[p];
@@ -53,7 +63,7 @@ void Tokenizer::tokenize(QVector<Token>& tokens){
                 p++;
                 pz=skipBlank(p);
             }
-            while(pz<s.size()&&isDigit(s[pz])) pz++;
+            pz = Scanner::skipDigits(s.constData(), pz, s.size());
             temp.s = s.mid(p,pz-p);
             if(isNegative) temp.s = "-" + temp.s;
             temp.type = ExpNodeType::number;
@@ -61,16 +71,19 @@ void Tokenizer::tokenize(QVector<Token>& tokens){
             p = pz;
         }
         else if (isLetter(s[p])){
-            //find a variable or "MOD"
-            while(pz<s.size()&&(isLetter(s[pz])||s[pz]=='_'||isDigit(s[pz]))) pz++;
+            //find a variable, an array element or "MOD"
+            pz = Scanner::skipIdentifier(s.constData(), pz, s.size());
             temp.s = s.mid(p,pz-p);
-            if(temp.s=="MOD"){
+            if(keywordOf(temp.s)==modKw){
                 temp.type = ExpNodeType::operation;
                 temp.opt = ExpOperation::mod;
             }
+            else if(currentChar(skipBlank(pz))=='('){
+                //the bracket stays a token of its own, see Expression::parseFactor
+                temp.type = ExpNodeType::element;
+            }
             else{
                 temp.type = ExpNodeType::variable;
-                temp.s = s.mid(p,pz-p);
             }
             p = pz;
         }
@@ -90,13 +103,14 @@ void Tokenizer::tokenize(QVector<Token>& tokens){
 
             p = pz+1;
         }
-        else if(s[p]=='('||s[p]==')'){
+        else if(isCharClass(s[p], bracketChar)){
             temp.s = s[p];
             temp.type = ExpNodeType::bracket;
             p = pz+1;
         }
         else{
-            throw std::invalid_argument(std::string("Invalid character: ") + s[p].toLatin1());
+            status.fail(ErrorCode::invalidCharacter, QString(s[p]));
+            return;
         }
         tokens.push_back(temp);
     }
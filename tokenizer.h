@@ -3,17 +3,19 @@
 
 #include <QString>
 #include <QVector>
+#include "status.h"
 
 class Program;
 
-enum ExpNodeType{
+enum ExpNodeType : unsigned char{
     variable,
     number,
     operation,
     bracket,
+    element,//a(i): element of an array, the index is the left operand
 };
 
-enum ExpOperation{
+enum ExpOperation : unsigned char{
     add,
     sub,
     mul,
@@ -34,7 +36,7 @@ class Tokenizer
 {
 public:
     Tokenizer(const QString& s,Program* program);
-    void tokenize(QVector<Token>& tokens);
+    void tokenize(QVector<Token>& tokens, Status& status);
 
 private:
     QString s;
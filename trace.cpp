@@ -0,0 +1,135 @@
+#include "trace.h"
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+
+/* Tracer::enable
+* Trace the following runs, sampling one statement in every sampleEvery
+* and keeping the last capacity events.
+*/
+void Tracer::enable(int sampleEvery, int capacity)
+{
+    this->sampleEvery = std::max(1, sampleEvery);
+    ring.assign(std::max(1, capacity), TraceEvent());
+    enabled = true;
+}
+
+void Tracer::disable()
+{
+    enabled = false;
+    ring = std::vector<TraceEvent>();
+    lines.clear();
+    counts = std::vector<quint64>();
+    sampledNs = std::vector<qint64>();
+    samples = std::vector<quint64>();
+}
+
+/* Tracer::beginRun
+* Forget the last run and start the clock.
+*/
+void Tracer::beginRun(const QVector<int>& planLines)
+{
+    lines = planLines;
+    counts.assign(lines.size(), 0);
+    sampledNs.assign(lines.size(), 0);
+    samples.assign(lines.size(), 0);
+    next = 0;
+    recorded = 0;
+    countdown = 1;//the first statement is always sampled
+    random = 2463534242u;
+    openIndex = -1;
+    clock.start();
+}
+
+/* Tracer::endRun
+* Close the last sampled statement and record the run itself.
+*/
+void Tracer::endRun()
+{
+    closeLine();
+    record(TraceKind::run, 0, 0);
+}
+
+/* Tracer::nextGap
+* Statements to the next sample: uniform in [1, 2 * sampleEvery - 1].
+*/
+int Tracer::nextGap()
+{
+    if(sampleEvery == 1) return 1;
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return 1 + int(random % quint32(2 * sampleEvery - 1));
+}
+
+void Tracer::closeLine()
+{
+    if(openIndex < 0) return;
+    qint64 end = now();
+    sampledNs[openIndex] += end - openStart;
+    samples[openIndex]++;
+    ring[next] = TraceEvent{openStart, end - openStart, lines[openIndex], TraceKind::line};
+    next = next + 1 == ring.size() ? 0 : next + 1;
+    recorded++;
+    openIndex = -1;
+}
+
+void Tracer::record(TraceKind kind, int line, qint64 start)
+{
+    ring[next] = TraceEvent{start, now() - start, line, kind};
+    next = next + 1 == ring.size() ? 0 : next + 1;
+    recorded++;
+}
+
+//microseconds, the time unit of the trace-event format
+static QString micros(qint64 ns)
+{
+    return QString::number(ns / 1000.0, 'f', 3);
+}
+
+/* Tracer::save
+* Write the events of the last run as Chrome trace-event JSON, oldest first.
+* The run event carries the aggregated statistics of every line: the exact
+* step count and, from the samples, an estimate of the time spent on it.
+*/
+bool Tracer::save(const QString& filename) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate)) return false;
+    QTextStream out(&file);
+    quint64 steps = 0;
+    for(quint64 count : counts) steps += count;
+    quint64 kept = std::min<quint64>(recorded, ring.size());
+    out << "{\"traceEvents\": [\n";
+    out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"QBasic\"}}";
+    for(quint64 i = 0; i < kept; i++){
+        const TraceEvent& event = ring[(next + ring.size() - kept + i) % ring.size()];
+        QString name, category;
+        switch(event.kind){
+        case TraceKind::run: name = "RUN"; category = "run"; break;
+        case TraceKind::line: name = "LINE " + QString::number(event.line); category = "line"; break;
+        case TraceKind::input: name = "INPUT"; category = "input"; break;
+        case TraceKind::blocked: name = "blocked"; category = "block"; break;
+        case TraceKind::output: name = "PRINT"; category = "output"; break;
+        }
+        out << ",\n{\"name\": \"" << name << "\", \"cat\": \"" << category << "\", \"ph\": \"X\", \"ts\": "
+            << micros(event.start) << ", \"dur\": " << micros(event.duration) << ", \"pid\": 1, \"tid\": 1, \"args\": {";
+        if(event.kind != TraceKind::run){
+            out << "\"line\": " << event.line << "}}";
+            continue;
+        }
+        out << "\"steps\": " << steps << ", \"sampleEvery\": " << sampleEvery
+            << ", \"droppedEvents\": " << (recorded - kept) << ", \"lines\": {";
+        bool first = true;
+        for(int j = 0; j < lines.size(); j++){
+            if(counts[j] == 0) continue;
+            qint64 estimatedNs = samples[j] ? qint64(double(sampledNs[j]) / samples[j] * counts[j]) : 0;
+            out << (first ? "" : ", ") << "\"" << lines[j] << "\": {\"steps\": " << counts[j]
+                << ", \"samples\": " << samples[j] << ", \"estimatedUs\": " << micros(estimatedNs) << "}";
+            first = false;
+        }
+        out << "}}}";
+    }
+    out << "\n],\n\"displayTimeUnit\": \"ns\"}\n";
+    return true;
+}
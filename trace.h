@@ -0,0 +1,81 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QVector>
+#include <QElapsedTimer>
+#include <vector>
+
+enum class TraceKind : unsigned char{
+    run,//the whole run
+    line,//a sampled statement
+    input,//INPUT waiting for its value
+    blocked,//the run blocked at a breakpoint or for input in the window
+    output,//a line written by PRINT
+};
+
+struct TraceEvent
+{
+    qint64 start;//ns since the start of the run
+    qint64 duration;//ns
+    int line;
+    TraceKind kind;
+};
+
+/*
+ * Tracer
+ * Timeline of a run, exported as Chrome trace-event JSON (chrome://tracing,
+ * ui.perfetto.dev). Events are kept in a ring buffer allocated when tracing
+ * is enabled; when it is full the oldest events are overwritten, so a trace
+ * never holds more than capacity events however long the run is.
+ * Only one statement in every sampleEvery, on average, becomes a line event;
+ * the gaps between samples are randomized so that a loop whose length
+ * divides sampleEvery is not always sampled on the same line. Every
+ * statement is counted, so the per-line step counts of the run are exact.
+ * INPUT waits, blocks and PRINT lines are always recorded.
+*/
+class Tracer
+{
+public:
+    static const int defaultCapacity = 1 << 16;
+    void enable(int sampleEvery = 1, int capacity = defaultCapacity);
+    void disable();
+    bool isEnabled() const { return enabled; }
+    void beginRun(const QVector<int>& planLines);//planLines: the line of every plan index
+    void endRun();
+    inline void step(int index);//called before the statement at plan index is executed
+    void closeLine();//end the sampled statement, if one is open
+    qint64 now() const { return clock.nsecsElapsed(); }
+    void record(TraceKind kind, int line, qint64 start);//an event from start to now
+    bool save(const QString& filename) const;
+
+private:
+    bool enabled = false;
+    int sampleEvery = 1;
+    int countdown = 1;
+    QElapsedTimer clock;
+    std::vector<TraceEvent> ring;
+    size_t next = 0;//slot of the next event
+    quint64 recorded = 0;//events recorded in the run, the ring keeps the last ones
+    QVector<int> lines;
+    std::vector<quint64> counts;//statements executed, by plan index
+    std::vector<qint64> sampledNs;//time of the sampled statements, by plan index
+    std::vector<quint64> samples;
+    int openIndex = -1;//plan index of the sampled statement running
+    qint64 openStart = 0;
+    quint32 random = 1;
+    int nextGap();
+};
+
+inline void Tracer::step(int index)
+{
+    counts[index]++;
+    if(openIndex >= 0) closeLine();
+    if(--countdown == 0){
+        countdown = nextGap();
+        openIndex = index;
+        openStart = now();
+    }
+}
+
+#endif // TRACE_H
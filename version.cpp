@@ -0,0 +1,102 @@
+#include "version.h"
+#include <algorithm>
+
+namespace {
+
+typedef ProgramVersion::Node Node;
+typedef ProgramVersion::NodePtr NodePtr;
+
+int height(const NodePtr& node) { return node ? node->height : 0; }
+int size(const NodePtr& node) { return node ? node->size : 0; }
+
+NodePtr makeNode(int line, const QString& text, const NodePtr& left, const NodePtr& right)
+{
+    return std::make_shared<const Node>(Node{line, text, left, right,
+        1 + std::max(height(left), height(right)), 1 + size(left) + size(right)});
+}
+
+/* balance
+* A new node with the given content, rotated so that the heights of its
+* subtrees differ by one at most. They differ by two at most on entry.
+*/
+NodePtr balance(int line, const QString& text, const NodePtr& left, const NodePtr& right)
+{
+    if(height(left) > height(right) + 1){
+        if(height(left->left) >= height(left->right))
+            return makeNode(left->line, left->text, left->left, makeNode(line, text, left->right, right));
+        const NodePtr& pivot = left->right;
+        return makeNode(pivot->line, pivot->text, makeNode(left->line, left->text, left->left, pivot->left),
+                        makeNode(line, text, pivot->right, right));
+    }
+    if(height(right) > height(left) + 1){
+        if(height(right->right) >= height(right->left))
+            return makeNode(right->line, right->text, makeNode(line, text, left, right->left), right->right);
+        const NodePtr& pivot = right->left;
+        return makeNode(pivot->line, pivot->text, makeNode(line, text, left, pivot->left),
+                        makeNode(right->line, right->text, pivot->right, right->right));
+    }
+    return makeNode(line, text, left, right);
+}
+
+NodePtr insert(const NodePtr& node, int line, const QString& text)
+{
+    if(!node) return makeNode(line, text, nullptr, nullptr);
+    if(line < node->line) return balance(node->line, node->text, insert(node->left, line, text), node->right);
+    if(line > node->line) return balance(node->line, node->text, node->left, insert(node->right, line, text));
+    return makeNode(line, text, node->left, node->right);
+}
+
+NodePtr removeFirst(const NodePtr& node, NodePtr& first)
+{
+    if(!node->left){
+        first = node;
+        return node->right;
+    }
+    return balance(node->line, node->text, removeFirst(node->left, first), node->right);
+}
+
+NodePtr remove(const NodePtr& node, int line)
+{
+    if(line < node->line) return balance(node->line, node->text, remove(node->left, line), node->right);
+    if(line > node->line) return balance(node->line, node->text, node->left, remove(node->right, line));
+    if(!node->left) return node->right;
+    if(!node->right) return node->left;
+    NodePtr first;
+    NodePtr right = removeFirst(node->right, first);
+    return balance(first->line, first->text, node->left, right);
+}
+
+}
+
+/* ProgramVersion::with
+* This version with the statement on line set to text.
+*/
+ProgramVersion ProgramVersion::with(int line, const QString& text) const
+{
+    return ProgramVersion(insert(root, line, text));
+}
+
+/* ProgramVersion::without
+* This version without the statement on line. The same version if there is
+* none.
+*/
+ProgramVersion ProgramVersion::without(int line) const
+{
+    if(!find(line)) return *this;
+    return ProgramVersion(remove(root, line));
+}
+
+/* ProgramVersion::find
+* The text of the statement on line, nullptr if there is none. Valid as
+* long as this version is.
+*/
+const QString* ProgramVersion::find(int line) const
+{
+    const Node* node = root.get();
+    while(node){
+        if(line < node->line) node = node->left.get();
+        else if(line > node->line) node = node->right.get();
+        else return &node->text;
+    }
+    return nullptr;
+}
@@ -0,0 +1,56 @@
+#ifndef VERSION_H
+#define VERSION_H
+
+#include <QString>
+#include <memory>
+
+/*
+ * ProgramVersion
+ * The text of a program at one point of its editing: its statements by
+ * line number, in a persistent AVL tree. A version never changes; an edit
+ * returns a new version that copies only the nodes on the path to the
+ * edited line, O(log n) of them, and shares every other node (and the
+ * text of every other statement) with the version it was made from.
+ * A version is a handle on its root: copying it pins the version, and the
+ * nodes no version uses any more are freed when the last handle on them
+ * goes. Nodes are immutable and counted atomically, so versions can be
+ * shared between threads.
+*/
+class ProgramVersion
+{
+public:
+    struct Node
+    {
+        int line;
+        QString text;
+        std::shared_ptr<const Node> left;
+        std::shared_ptr<const Node> right;
+        int height;
+        int size;//statements in this subtree
+    };
+    typedef std::shared_ptr<const Node> NodePtr;
+
+    ProgramVersion() = default;
+    ProgramVersion with(int line, const QString& text) const;
+    ProgramVersion without(int line) const;
+    const QString* find(int line) const;
+    int size() const { return root ? root->size : 0; }
+    bool empty() const { return !root; }
+/* True if both are the same version, or share all their nodes.*/
+    bool isSameAs(const ProgramVersion& other) const { return root == other.root; }
+/* Call f(line, text) for every statement, in order of line number.*/
+    template<class F> void forEach(F f) const { forEach(root.get(), f); }
+
+private:
+    explicit ProgramVersion(NodePtr root) : root(std::move(root)) {}
+    template<class F> static void forEach(const Node* node, F& f)
+    {
+        if(!node) return;
+        forEach(node->left.get(), f);
+        f(node->line, node->text);
+        forEach(node->right.get(), f);
+    }
+    NodePtr root;
+};
+
+#endif // VERSION_H